@@ -0,0 +1,559 @@
+#ifndef ASYNC_IO_H
+#define ASYNC_IO_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <streambuf>
+#include <istream>
+#include <ostream>
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+// Asynchronous reads and writes with a fixed set of buffers ("slots") per
+// file, so several large requests are in flight while the caller works.
+// Uses io_uring (raw syscalls, no liburing) when the kernel allows it,
+// otherwise a small shared pool of threads doing pread/pwrite.
+class AsyncIO {
+public:
+    enum class Backend { Auto, Uring, Threads };
+
+    virtual ~AsyncIO() = default;
+
+    virtual void submit(bool write, int fd, unsigned slot, char* buf, size_t len, off_t offset) = 0;
+
+    // Waits for any request to finish: its slot and bytes done (or -errno)
+    virtual void wait(unsigned& slot, ssize_t& result) = 0;
+
+    virtual const char* name() const = 0;
+
+    static Backend& backend() {
+        static Backend b = Backend::Auto;
+        return b;
+    }
+
+    // One instance per file; `buffers` are the slots, registered with the
+    // kernel where possible
+    static std::unique_ptr<AsyncIO> create(const std::vector<iovec>& buffers);
+};
+
+// Minimal io_uring: one submission per request, fixed buffers if they
+// could be registered
+class UringIO : public AsyncIO {
+    int ringFd = -1;
+    unsigned entries = 0;
+    bool fixed = false;
+
+    void* sqPtr = nullptr;
+    void* cqPtr = nullptr;
+    size_t sqSize = 0;
+    size_t cqSize = 0;
+    io_uring_sqe* sqes = nullptr;
+    size_t sqesSize = 0;
+
+    unsigned* sqTail;
+    unsigned* sqMask;
+    unsigned* sqArray;
+    unsigned* cqHead;
+    unsigned* cqTail;
+    unsigned* cqMask;
+    io_uring_cqe* cqes;
+
+    static int enter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags) {
+        return (int)syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, nullptr, 0);
+    }
+
+public:
+    // False if io_uring isn't usable here (old kernel, seccomp, ...)
+    bool init(const std::vector<iovec>& buffers) {
+        io_uring_params p{};
+        entries = std::max<unsigned>(buffers.size(), 1);
+        ringFd = (int)syscall(__NR_io_uring_setup, entries, &p);
+        if (ringFd < 0) return false;
+
+        sqSize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+        cqSize = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+        bool single = p.features & IORING_FEAT_SINGLE_MMAP;
+        if (single) sqSize = cqSize = std::max(sqSize, cqSize);
+
+        sqPtr = mmap(nullptr, sqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                     ringFd, IORING_OFF_SQ_RING);
+        if (sqPtr == MAP_FAILED) return false;
+        if (single) {
+            cqPtr = sqPtr;
+        } else {
+            cqPtr = mmap(nullptr, cqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                         ringFd, IORING_OFF_CQ_RING);
+            if (cqPtr == MAP_FAILED) return false;
+        }
+        sqesSize = p.sq_entries * sizeof(io_uring_sqe);
+        sqes = (io_uring_sqe*)mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE,
+                                   MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+        if (sqes == MAP_FAILED) return false;
+
+        char* sq = (char*)sqPtr;
+        char* cq = (char*)cqPtr;
+        sqTail = (unsigned*)(sq + p.sq_off.tail);
+        sqMask = (unsigned*)(sq + p.sq_off.ring_mask);
+        sqArray = (unsigned*)(sq + p.sq_off.array);
+        cqHead = (unsigned*)(cq + p.cq_off.head);
+        cqTail = (unsigned*)(cq + p.cq_off.tail);
+        cqMask = (unsigned*)(cq + p.cq_off.ring_mask);
+        cqes = (io_uring_cqe*)(cq + p.cq_off.cqes);
+
+        // Registered buffers save a page pin per request; they count
+        // against RLIMIT_MEMLOCK, so plain reads and writes are the fallback
+        fixed = syscall(__NR_io_uring_register, ringFd, IORING_REGISTER_BUFFERS,
+                        buffers.data(), (unsigned)buffers.size()) == 0;
+        return true;
+    }
+
+    ~UringIO() override {
+        if (sqes && sqes != MAP_FAILED) munmap(sqes, sqesSize);
+        if (cqPtr && cqPtr != MAP_FAILED && cqPtr != sqPtr) munmap(cqPtr, cqSize);
+        if (sqPtr && sqPtr != MAP_FAILED) munmap(sqPtr, sqSize);
+        if (ringFd >= 0) close(ringFd);
+    }
+
+    void submit(bool write, int fd, unsigned slot, char* buf, size_t len, off_t offset) override {
+        unsigned tail = *sqTail;
+        unsigned index = tail & *sqMask;
+        io_uring_sqe& sqe = sqes[index];
+        memset(&sqe, 0, sizeof(sqe));
+        if (fixed) {
+            sqe.opcode = write ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED;
+            sqe.buf_index = slot;
+        } else {
+            sqe.opcode = write ? IORING_OP_WRITE : IORING_OP_READ;
+        }
+        sqe.fd = fd;
+        sqe.addr = (uint64_t)(uintptr_t)buf;
+        sqe.len = (uint32_t)len;
+        sqe.off = (uint64_t)offset;
+        sqe.user_data = slot;
+        sqArray[index] = index;
+        __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+
+        while (enter(ringFd, 1, 0, 0) < 0) {
+            if (errno != EINTR && errno != EAGAIN) {
+                throw std::runtime_error("io_uring submit failed: " + std::string(strerror(errno)));
+            }
+        }
+    }
+
+    void wait(unsigned& slot, ssize_t& result) override {
+        unsigned head = *cqHead;
+        while (head == __atomic_load_n(cqTail, __ATOMIC_ACQUIRE)) {
+            if (enter(ringFd, 0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR) {
+                throw std::runtime_error("io_uring wait failed: " + std::string(strerror(errno)));
+            }
+        }
+        const io_uring_cqe& cqe = cqes[head & *cqMask];
+        slot = (unsigned)cqe.user_data;
+        result = cqe.res;
+        __atomic_store_n(cqHead, head + 1, __ATOMIC_RELEASE);
+    }
+
+    const char* name() const override { return fixed ? "io_uring (registered buffers)" : "io_uring"; }
+};
+
+// Fallback: requests go to a process-wide pool of I/O threads
+class ThreadPoolIO : public AsyncIO {
+    struct Request {
+        ThreadPoolIO* owner;
+        bool write;
+        int fd;
+        unsigned slot;
+        char* buf;
+        size_t len;
+        off_t offset;
+    };
+
+    class Pool {
+        std::mutex lock;
+        std::condition_variable cv;
+        std::deque<Request> requests;
+        std::vector<std::thread> threads;
+        bool stopping = false;
+
+        void run() {
+            while (true) {
+                Request r;
+                {
+                    std::unique_lock<std::mutex> guard(lock);
+                    cv.wait(guard, [this]() { return !requests.empty() || stopping; });
+                    if (requests.empty()) return;
+                    r = requests.front();
+                    requests.pop_front();
+                }
+                ssize_t done = r.write ? pwrite(r.fd, r.buf, r.len, r.offset)
+                                       : pread(r.fd, r.buf, r.len, r.offset);
+                r.owner->complete(r.slot, done < 0 ? -errno : done);
+            }
+        }
+
+    public:
+        explicit Pool(unsigned n) {
+            for (unsigned i = 0; i < n; i++) threads.emplace_back(&Pool::run, this);
+        }
+
+        ~Pool() {
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                stopping = true;
+            }
+            cv.notify_all();
+            for (auto& t : threads) t.join();
+        }
+
+        void push(const Request& r) {
+            std::lock_guard<std::mutex> guard(lock);
+            requests.push_back(r);
+            cv.notify_one();
+        }
+    };
+
+    static Pool& pool() {
+        static Pool p(4);
+        return p;
+    }
+
+    std::mutex lock;
+    std::condition_variable cv;
+    std::deque<std::pair<unsigned, ssize_t>> done;
+
+    void complete(unsigned slot, ssize_t result) {
+        std::lock_guard<std::mutex> guard(lock);
+        done.push_back({slot, result});
+        cv.notify_one();
+    }
+
+public:
+    void submit(bool write, int fd, unsigned slot, char* buf, size_t len, off_t offset) override {
+        pool().push({this, write, fd, slot, buf, len, offset});
+    }
+
+    void wait(unsigned& slot, ssize_t& result) override {
+        std::unique_lock<std::mutex> guard(lock);
+        cv.wait(guard, [this]() { return !done.empty(); });
+        slot = done.front().first;
+        result = done.front().second;
+        done.pop_front();
+    }
+
+    const char* name() const override { return "thread pool"; }
+};
+
+inline std::unique_ptr<AsyncIO> AsyncIO::create(const std::vector<iovec>& buffers) {
+    if (backend() != Backend::Threads) {
+        auto ring = std::make_unique<UringIO>();
+        if (ring->init(buffers)) return ring;
+        if (backend() == Backend::Uring) throw std::runtime_error("io_uring is not available");
+    }
+    return std::make_unique<ThreadPoolIO>();
+}
+
+// Backend a new file would get, for reporting
+inline std::string asyncBackendName() {
+    char byte;
+    return AsyncIO::create({{&byte, 1}})->name();
+}
+
+// Fixed slot buffers plus bookkeeping shared by the reader and writer
+class AsyncSlots {
+protected:
+    int fd = -1;
+    size_t slotSize;
+    std::vector<std::vector<char>> slots;
+    std::vector<bool> busy;
+    std::vector<ssize_t> results;
+    std::unique_ptr<AsyncIO> io;
+
+    AsyncSlots(unsigned numSlots, size_t size)
+        : slotSize(size), slots(std::max(numSlots, 1u)), busy(slots.size(), false),
+          results(slots.size(), 0) {
+        std::vector<iovec> iov;
+        for (auto& s : slots) {
+            s.resize(slotSize);
+            iov.push_back({s.data(), slotSize});
+        }
+        io = AsyncIO::create(iov);
+    }
+
+    // Blocks until the request on `slot` (if any) has finished
+    ssize_t waitFor(unsigned slot) {
+        while (busy[slot]) {
+            unsigned s;
+            ssize_t r;
+            io->wait(s, r);
+            busy[s] = false;
+            results[s] = r;
+        }
+        return results[slot];
+    }
+
+    void waitAll() {
+        for (unsigned s = 0; s < slots.size(); s++) waitFor(s);
+    }
+
+public:
+    const char* backendName() const { return io->name(); }
+};
+
+// Sequential reader for a regular file that keeps every slot's read in
+// flight ahead of the caller
+class AsyncReader : public AsyncSlots {
+    off_t nextOffset = 0;     // where the next read is issued
+    std::vector<off_t> offsets;
+    unsigned current = 0;     // slot being consumed
+    size_t pos = 0;
+    size_t avail = 0;
+    bool eof = false;
+
+    void issue(unsigned slot) {
+        offsets[slot] = nextOffset;
+        io->submit(false, fd, slot, slots[slot].data(), slotSize, nextOffset);
+        busy[slot] = true;
+        nextOffset += slotSize;
+    }
+
+    // Makes `current` the next slot with data; false at end of file
+    bool advance() {
+        if (eof) return false;
+        ssize_t got = waitFor(current);
+        if (got < 0) throw std::runtime_error("Read error: " + std::string(strerror(-got)));
+        if (got == 0) {
+            eof = true;
+            return false;
+        }
+        if ((size_t)got < slotSize) {
+            // Short read: the other slots are at the wrong offsets, so drop
+            // them and continue right after this one
+            for (unsigned s = 0; s < slots.size(); s++) {
+                if (s != current) waitFor(s);
+            }
+            nextOffset = offsets[current] + got;
+            for (unsigned i = 1; i < slots.size(); i++) issue((current + i) % slots.size());
+        }
+        pos = 0;
+        avail = got;
+        return true;
+    }
+
+public:
+    AsyncReader(const std::string& path, unsigned numSlots = 4, size_t size = 1 << 20)
+        : AsyncSlots(numSlots, size), offsets(slots.size(), 0) {
+        fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) throw std::runtime_error("Could not open file: " + path);
+        for (unsigned s = 0; s < slots.size(); s++) issue(s);
+    }
+
+    ~AsyncReader() {
+        if (fd >= 0) {
+            waitAll();
+            ::close(fd);
+        }
+    }
+
+    // Next chunk of data, valid until the following call
+    bool nextChunk(const char*& data, size_t& n) {
+        if (avail > 0) {
+            // Done with the current slot: reuse it for a read further ahead
+            if (!eof) issue(current);
+            pos = avail = 0;
+            current = (current + 1) % slots.size();
+        }
+        if (!advance()) return false;
+        data = slots[current].data();
+        n = avail;
+        return true;
+    }
+
+    size_t read(char* buf, size_t n) {
+        if (pos == avail) {
+            const char* data;
+            size_t got;
+            if (!nextChunk(data, got)) return 0;
+        }
+        size_t c = std::min(n, avail - pos);
+        memcpy(buf, slots[current].data() + pos, c);
+        pos += c;
+        return c;
+    }
+};
+
+// Sequential writer: a full slot is written in the background while the
+// caller fills the next one
+class AsyncWriter : public AsyncSlots {
+    off_t offset = 0;
+    std::vector<size_t> lengths;
+    std::vector<off_t> offsetOf;
+    unsigned current = 0;
+    bool failed = false;
+
+    void check(unsigned slot) {
+        ssize_t done = waitFor(slot);
+        if (lengths[slot] == 0) return;
+        if (done < 0) {
+            failed = true;
+        } else if ((size_t)done < lengths[slot]) {
+            // Short write: finish it synchronously
+            off_t at = offsetOf[slot] + done;
+            const char* p = slots[slot].data() + done;
+            size_t left = lengths[slot] - done;
+            while (left > 0) {
+                ssize_t w = pwrite(fd, p, left, at);
+                if (w <= 0) {
+                    failed = true;
+                    break;
+                }
+                p += w;
+                at += w;
+                left -= w;
+            }
+        }
+        lengths[slot] = 0;
+    }
+
+public:
+    AsyncWriter(const std::string& path, unsigned numSlots = 4, size_t size = 1 << 20)
+        : AsyncSlots(numSlots, size), lengths(slots.size(), 0), offsetOf(slots.size(), 0) {
+        fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) throw std::runtime_error("Could not open file for writing: " + path);
+    }
+
+    ~AsyncWriter() {
+        if (fd >= 0) {
+            waitAll();
+            ::close(fd);
+        }
+    }
+
+    // Buffer the caller fills, slotSize bytes
+    char* buffer() { return slots[current].data(); }
+    size_t capacity() const { return slotSize; }
+
+    // Writes the first n bytes of buffer() and moves to the next slot
+    void commit(size_t n) {
+        if (n == 0) return;
+        lengths[current] = n;
+        offsetOf[current] = offset;
+        io->submit(true, fd, current, slots[current].data(), n, offset);
+        busy[current] = true;
+        offset += n;
+        current = (current + 1) % slots.size();
+        check(current);
+    }
+
+    // Waits for every write; false if any failed
+    bool close() {
+        if (fd < 0) return !failed;
+        for (unsigned s = 0; s < slots.size(); s++) check(s);
+        if (::close(fd) != 0) failed = true;
+        fd = -1;
+        return !failed;
+    }
+};
+
+// std::istream / std::ostream over the async reader and writer, so code
+// written against iostreams (run files, output) gets read-ahead and
+// write-behind without changes
+class AsyncInBuf : public std::streambuf {
+    AsyncReader reader;
+
+protected:
+    int_type underflow() override {
+        const char* data;
+        size_t n;
+        if (!reader.nextChunk(data, n)) return traits_type::eof();
+        char* p = const_cast<char*>(data);
+        setg(p, p, p + n);
+        return traits_type::to_int_type(*p);
+    }
+
+public:
+    AsyncInBuf(const std::string& path, unsigned slots, size_t size) : reader(path, slots, size) {}
+};
+
+class AsyncOutBuf : public std::streambuf {
+    AsyncWriter writer;
+
+    void flushSlot() {
+        writer.commit(pptr() - pbase());
+        setp(writer.buffer(), writer.buffer() + writer.capacity());
+    }
+
+protected:
+    int_type overflow(int_type c) override {
+        flushSlot();
+        if (!traits_type::eq_int_type(c, traits_type::eof())) {
+            *pptr() = traits_type::to_char_type(c);
+            pbump(1);
+        }
+        return traits_type::not_eof(c);
+    }
+
+    std::streamsize xsputn(const char* s, std::streamsize n) override {
+        std::streamsize done = 0;
+        while (done < n) {
+            if (pptr() == epptr()) flushSlot();
+            std::streamsize c = std::min<std::streamsize>(n - done, epptr() - pptr());
+            memcpy(pptr(), s + done, c);
+            pbump((int)c);
+            done += c;
+        }
+        return n;
+    }
+
+public:
+    AsyncOutBuf(const std::string& path, unsigned slots, size_t size) : writer(path, slots, size) {
+        setp(writer.buffer(), writer.buffer() + writer.capacity());
+    }
+
+    bool close() {
+        flushSlot();
+        return writer.close();
+    }
+};
+
+class AsyncIFStream : public std::istream {
+    AsyncInBuf buf;
+
+public:
+    explicit AsyncIFStream(const std::string& path, unsigned slots = 4, size_t size = 1 << 20)
+        : std::istream(nullptr), buf(path, slots, size) {
+        rdbuf(&buf);
+    }
+};
+
+class AsyncOFStream : public std::ostream {
+    AsyncOutBuf buf;
+
+public:
+    explicit AsyncOFStream(const std::string& path, unsigned slots = 4, size_t size = 1 << 20)
+        : std::ostream(nullptr), buf(path, slots, size) {
+        rdbuf(&buf);
+    }
+
+    ~AsyncOFStream() { buf.close(); }
+
+    // Writes out everything buffered; sets failbit if any write failed
+    void close() {
+        if (!buf.close()) setstate(std::ios::failbit);
+    }
+};
+
+#endif
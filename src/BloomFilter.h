@@ -0,0 +1,52 @@
+#ifndef BLOOM_FILTER_H
+#define BLOOM_FILTER_H
+
+#include <atomic>
+#include <memory>
+#include <algorithm>
+#include <cstdint>
+#include "Kmer.h"
+
+// Blocked Bloom filter shared by all workers. Every key sets `hashes` bits
+// inside a single 64-byte block, so a lookup touches one cache line. Bits
+// are set with atomic fetch_or; two threads adding the same new key at the
+// same moment can both see it as absent.
+class BloomFilter {
+    static constexpr size_t BLOCK_WORDS = 8;  // 512 bits
+
+    std::unique_ptr<std::atomic<uint64_t>[]> words;
+    size_t numBlocks;
+    int hashes;
+
+public:
+    // Uses about `bytes` of memory (at least one block)
+    explicit BloomFilter(size_t bytes, int hashes = 5)
+        : numBlocks(std::max<size_t>(1, bytes / (BLOCK_WORDS * 8))), hashes(hashes) {
+        words.reset(new std::atomic<uint64_t>[numBlocks * BLOCK_WORDS]);
+        for (size_t i = 0; i < numBlocks * BLOCK_WORDS; i++) words[i].store(0, std::memory_order_relaxed);
+    }
+
+    size_t bytes() const { return numBlocks * BLOCK_WORDS * 8; }
+
+    // Adds the key with this hash; true if it was (probably) there already
+    bool testAndSet(uint64_t hash) {
+        // Re-mix so the bits are independent of the table's probe position
+        uint64_t h = mix64(hash ^ 0x9e3779b97f4a7c15ULL);
+        // High half picks the block, low half the bits inside it
+        std::atomic<uint64_t>* block = &words[(h >> 32) % numBlocks * BLOCK_WORDS];
+        uint32_t bit = (uint32_t)h;
+        uint32_t step = (bit >> 16) | 1;
+        bool present = true;
+        for (int i = 0; i < hashes; i++, bit += step) {
+            uint64_t mask = 1ULL << (bit & 63);
+            std::atomic<uint64_t>& word = block[(bit >> 6) % BLOCK_WORDS];
+            if (!(word.load(std::memory_order_relaxed) & mask)) {
+                word.fetch_or(mask, std::memory_order_relaxed);
+                present = false;
+            }
+        }
+        return present;
+    }
+};
+
+#endif
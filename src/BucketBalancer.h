@@ -0,0 +1,144 @@
+#ifndef BUCKET_BALANCER_H
+#define BUCKET_BALANCER_H
+
+#include <vector>
+#include <queue>
+#include <algorithm>
+#include <iostream>
+#include <cstdint>
+#include "Kmer.h"
+
+// Maps minimizer buckets to Hasher workers. Minimizers are hashed into a
+// fixed number of partitions; partitions are assigned to workers with a
+// greedy longest-processing-time bin packing over sampled sizes, and the
+// assignment is redone as the input streams whenever the projected load
+// drifts out of balance. A partition that moves leaves its old k-mers in
+// the previous worker's table; mergeResults sums them, so counts stay exact.
+class BucketBalancer {
+    unsigned numWorkers;
+    size_t numPartitions;
+    size_t rebalanceInterval;
+    double maxImbalance;
+
+    std::vector<unsigned> owner;        // partition -> worker
+    std::vector<size_t> window;         // k-mers per partition since last rebalance
+    std::vector<size_t> routed;         // k-mers sent to each worker so far
+    std::vector<bool> used;             // partition has had k-mers routed
+    size_t windowKmers = 0;
+
+    size_t numRebalances = 0;
+    size_t numMoves = 0;
+    bool splitPartitions = false;
+
+    // Worst projected worker load over mean if the window's distribution
+    // repeats under the current assignment
+    double projectedImbalance() const {
+        std::vector<size_t> load(routed);
+        size_t total = 0;
+        for (size_t p = 0; p < numPartitions; p++) {
+            load[owner[p]] += window[p];
+        }
+        for (size_t l : load) total += l;
+        if (total == 0) return 1.0;
+        double mean = (double)total / numWorkers;
+        return *std::max_element(load.begin(), load.end()) / mean;
+    }
+
+public:
+    BucketBalancer(unsigned workers, size_t partitionsPerWorker = 16,
+                   size_t rebalanceInterval = 1 << 22, double maxImbalance = 1.05)
+        : numWorkers(workers), numPartitions((size_t)workers * partitionsPerWorker),
+          rebalanceInterval(rebalanceInterval), maxImbalance(maxImbalance),
+          owner(numPartitions), window(numPartitions, 0), routed(workers, 0),
+          used(numPartitions, false) {
+        // Static round-robin until the first sample comes in
+        for (size_t p = 0; p < numPartitions; p++) owner[p] = p % numWorkers;
+    }
+
+    size_t partitionOf(uint64_t minimizer) const {
+        return mix64(minimizer) % numPartitions;
+    }
+
+    // Record a bucket's size without routing it (initial sampling)
+    void sample(uint64_t minimizer, size_t kmers) {
+        window[partitionOf(minimizer)] += kmers;
+        windowKmers += kmers;
+    }
+
+    // Worker for a super-mer with this minimizer and number of k-mers
+    unsigned route(uint64_t minimizer, size_t kmers) {
+        size_t p = partitionOf(minimizer);
+        unsigned w = owner[p];
+        window[p] += kmers;
+        windowKmers += kmers;
+        routed[w] += kmers;
+        used[p] = true;
+
+        if (rebalanceInterval > 0 && windowKmers >= rebalanceInterval) {
+            rebalance();
+        }
+        return w;
+    }
+
+    // Greedy bin packing of the window's partitions, largest first, onto
+    // the worker with the least load (already routed + newly packed)
+    void rebalance() {
+        if (windowKmers > 0 && projectedImbalance() > maxImbalance) {
+            std::vector<size_t> order(numPartitions);
+            for (size_t p = 0; p < numPartitions; p++) order[p] = p;
+            std::sort(order.begin(), order.end(),
+                      [this](size_t a, size_t b) { return window[a] > window[b]; });
+
+            using Load = std::pair<size_t, unsigned>;
+            std::priority_queue<Load, std::vector<Load>, std::greater<Load>> heap;
+            for (unsigned w = 0; w < numWorkers; w++) heap.push({routed[w], w});
+
+            for (size_t p : order) {
+                if (window[p] == 0) break;  // unseen partitions keep their owner
+                auto [load, w] = heap.top();
+                heap.pop();
+                if (owner[p] != w) {
+                    numMoves++;
+                    if (used[p]) splitPartitions = true;
+                }
+                owner[p] = w;
+                heap.push({load + window[p], w});
+            }
+            numRebalances++;
+        }
+        std::fill(window.begin(), window.end(), 0);
+        windowKmers = 0;
+    }
+
+    // Partitions holding more than `factor` times the mean partition's
+    // share of the k-mers seen since the last rebalance (the sample, before
+    // the first one)
+    std::vector<bool> heavyPartitions(double factor) const {
+        std::vector<bool> heavy(numPartitions, false);
+        double mean = (double)windowKmers / numPartitions;
+        for (size_t p = 0; p < numPartitions; p++) heavy[p] = windowKmers > 0 && window[p] > factor * mean;
+        return heavy;
+    }
+
+    // True once a partition moved after some of its k-mers were routed, so
+    // those k-mers may be counted in two workers' tables
+    bool partitionsSplit() const { return splitPartitions; }
+
+    void printStats(std::ostream& out) const {
+        size_t total = 0;
+        for (size_t l : routed) total += l;
+        out << "Bucket balancer: " << numPartitions << " partitions over "
+            << numWorkers << " workers, " << numRebalances << " rebalances, "
+            << numMoves << " partition moves\n";
+        if (total == 0) return;
+
+        double mean = (double)total / numWorkers;
+        for (unsigned w = 0; w < numWorkers; w++) {
+            out << "  Worker " << w << ": " << routed[w] << " k-mers\n";
+        }
+        out << "  Max/mean worker load: "
+            << *std::max_element(routed.begin(), routed.end()) / mean << "\n";
+    }
+};
+
+#endif
@@ -0,0 +1,378 @@
+#ifndef COUNT_FILE_H
+#define COUNT_FILE_H
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <algorithm>
+#include <stdexcept>
+#include <cstring>
+#include <cstdint>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "AsyncIO.h"
+#include "ThreadPool.h"
+
+// Compressed, block-indexed k-mer count file for packed keys.
+//
+//   header   "KCB1", k, key size in bytes, records per block (4 x u32)
+//   blocks   sorted records; each block starts with its first key as a
+//            varint, then key deltas as varints, each followed by the
+//            count as a varint
+//   index    per block: file offset, records, bytes, first key
+//   trailer  index offset, number of blocks, number of records, "KCBINDEX"
+//
+// Blocks decode independently, so a reader can binary search the index to
+// seek to a k-mer or hand blocks to several threads, and an update can
+// copy the blocks it doesn't change.
+
+template <typename Key>
+struct CountFileIndexEntry {
+    uint64_t offset;
+    uint32_t records;
+    uint32_t bytes;
+    Key firstKey;
+};
+
+struct CountFileTrailer {
+    uint64_t indexOffset;
+    uint64_t numBlocks;
+    uint64_t numRecords;
+    char magic[8];
+};
+
+// LEB128: 7 bits per byte, high bit set on all but the last byte
+template <typename T>
+inline void putVarint(std::string& out, T v) {
+    while (v >= 0x80) {
+        out += (char)((uint8_t)v | 0x80);
+        v >>= 7;
+    }
+    out += (char)(uint8_t)v;
+}
+
+template <typename T>
+inline const char* getVarint(const char* p, const char* end, T& v) {
+    v = 0;
+    for (int shift = 0; p < end && shift < (int)sizeof(T) * 8; shift += 7) {
+        uint8_t b = (uint8_t)*p++;
+        v |= (T)(b & 0x7f) << shift;
+        if (!(b & 0x80)) return p;
+    }
+    throw std::runtime_error("Corrupt count file block");
+}
+
+// Sorts in `threads` chunks on the pool: chunks are sorted in parallel,
+// then merged pairwise in parallel rounds
+template <typename T>
+void sortParallel(std::vector<T>& v, unsigned threads, TaskPool& pool = TaskPool::global()) {
+    size_t n = std::max(1u, threads);
+    if (v.size() < 1 << 16 || n == 1) {
+        std::sort(v.begin(), v.end());
+        return;
+    }
+    std::vector<size_t> bounds;
+    for (size_t i = 0; i <= n; i++) bounds.push_back(v.size() * i / n);
+
+    pool.parallelFor(n, [&](size_t i) { std::sort(v.begin() + bounds[i], v.begin() + bounds[i + 1]); });
+
+    for (size_t width = 1; width < n; width *= 2) {
+        size_t pairs = (n - width + 2 * width - 1) / (2 * width);
+        pool.parallelFor(pairs, [&](size_t j) {
+            size_t i = j * 2 * width;
+            size_t lo = bounds[i], mid = bounds[i + width], hi = bounds[std::min(i + 2 * width, n)];
+            std::inplace_merge(v.begin() + lo, v.begin() + mid, v.begin() + hi);
+        });
+    }
+}
+
+template <typename Traits>
+class CountFileWriter {
+public:
+    using Key = typename Traits::Key;
+    using Record = std::pair<Key, uint64_t>;
+
+private:
+    AsyncOFStream out;
+    std::string path;
+    uint32_t blockRecords;
+    uint64_t offset = 0;
+    uint64_t records = 0;
+    std::vector<Record> pending;
+    std::vector<CountFileIndexEntry<Key>> index;
+
+    static std::string encodeBlock(const Record* begin, const Record* end) {
+        std::string block;
+        block.reserve((end - begin) * 4);
+        Key prev = 0;
+        for (const Record* r = begin; r != end; r++) {
+            putVarint(block, r == begin ? r->first : r->first - prev);
+            putVarint(block, r->second);
+            prev = r->first;
+        }
+        return block;
+    }
+
+    void append(const std::string& block, const Record* begin, size_t n) {
+        index.push_back({offset, (uint32_t)n, (uint32_t)block.size(), begin->first});
+        out.write(block.data(), block.size());
+        offset += block.size();
+        records += n;
+    }
+
+    void flushPending() {
+        if (pending.empty()) return;
+        append(encodeBlock(pending.data(), pending.data() + pending.size()), pending.data(), pending.size());
+        pending.clear();
+    }
+
+public:
+    explicit CountFileWriter(const std::string& p, uint32_t blockRecords = 4096, unsigned slots = 4,
+                             size_t slotBytes = 1 << 20)
+        : out(p, slots, slotBytes), path(p), blockRecords(std::max(1u, blockRecords)) {
+        uint32_t header[4];
+        memcpy(header, "KCB1", 4);
+        header[1] = Traits::k;
+        header[2] = sizeof(Key);
+        header[3] = this->blockRecords;
+        out.write(reinterpret_cast<const char*>(header), sizeof(header));
+        offset = sizeof(header);
+        pending.reserve(this->blockRecords);
+    }
+
+    // Records must arrive in ascending key order
+    void add(Key key, uint64_t count) {
+        pending.push_back({key, count});
+        if (pending.size() == blockRecords) flushPending();
+    }
+
+    // A whole sorted table; its blocks are encoded by `threads` tasks
+    void addSorted(const Record* data, size_t n, unsigned threads, TaskPool& pool = TaskPool::global()) {
+        flushPending();
+        size_t numBlocks = (n + blockRecords - 1) / blockRecords;
+        unsigned workers = std::max<size_t>(1, std::min<size_t>(threads, numBlocks));
+        // Encode a batch of blocks per thread at a time to bound memory
+        size_t batch = (size_t)workers * 64;
+        std::vector<std::string> encoded(std::min(batch, numBlocks));
+
+        for (size_t first = 0; first < numBlocks; first += batch) {
+            size_t count = std::min(batch, numBlocks - first);
+            pool.parallelFor(workers, [&](size_t t) {
+                for (size_t b = t; b < count; b += workers) {
+                    size_t lo = (first + b) * blockRecords;
+                    size_t hi = std::min(n, lo + blockRecords);
+                    encoded[b] = encodeBlock(data + lo, data + hi);
+                }
+            });
+            for (size_t b = 0; b < count; b++) {
+                size_t lo = (first + b) * blockRecords;
+                append(encoded[b], data + lo, std::min<size_t>(blockRecords, n - lo));
+            }
+        }
+    }
+
+    // A block of another count file with the same k, as it is; ends the
+    // block being filled. Its keys must follow the ones written so far.
+    void copyBlock(const char* data, const CountFileIndexEntry<Key>& entry) {
+        flushPending();
+        index.push_back({offset, entry.records, entry.bytes, entry.firstKey});
+        out.write(data, entry.bytes);
+        offset += entry.bytes;
+        records += entry.records;
+    }
+
+    size_t size() const { return records + pending.size(); }
+
+    void close() {
+        flushPending();
+        CountFileTrailer trailer;
+        trailer.indexOffset = offset;
+        trailer.numBlocks = index.size();
+        trailer.numRecords = records;
+        memcpy(trailer.magic, "KCBINDEX", 8);
+        out.write(reinterpret_cast<const char*>(index.data()), index.size() * sizeof(index[0]));
+        out.write(reinterpret_cast<const char*>(&trailer), sizeof(trailer));
+        out.close();
+        if (!out) throw std::runtime_error("Could not write " + path);
+    }
+};
+
+// k of a count file from its header, 0 if it isn't one
+inline uint32_t countFileK(const std::string& path) {
+    uint32_t header[4] = {0, 0, 0, 0};
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return 0;
+    ssize_t n = pread(fd, header, sizeof(header), 0);
+    close(fd);
+    if (n != (ssize_t)sizeof(header) || memcmp(header, "KCB1", 4) != 0) return 0;
+    return header[1];
+}
+
+// Maps the file read-only; blocks are decoded straight from the mapping,
+// so only the pages of the blocks that are read come off the disk.
+// readBlock is safe to call from several threads.
+template <typename Traits>
+class CountFileReader {
+public:
+    using Key = typename Traits::Key;
+    using Record = std::pair<Key, uint64_t>;
+    using IndexEntry = CountFileIndexEntry<Key>;
+
+private:
+    std::string path;
+    const char* data = nullptr;
+    size_t bytes = 0;
+    CountFileTrailer trailer;
+    std::vector<IndexEntry> index;
+
+public:
+    explicit CountFileReader(const std::string& p) : path(p) {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) throw std::runtime_error("Could not open " + path);
+        struct stat st;
+        fstat(fd, &st);
+        bytes = st.st_size;
+        uint32_t header[4];
+        if (bytes < sizeof(header) + sizeof(trailer)) {
+            close(fd);
+            throw std::runtime_error(path + " is not a count file");
+        }
+        void* mapped = mmap(nullptr, bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (mapped == MAP_FAILED) throw std::runtime_error("Could not map " + path);
+        data = (const char*)mapped;
+
+        memcpy(header, data, sizeof(header));
+        memcpy(&trailer, data + bytes - sizeof(trailer), sizeof(trailer));
+        if (memcmp(header, "KCB1", 4) != 0 || memcmp(trailer.magic, "KCBINDEX", 8) != 0 ||
+            trailer.indexOffset + trailer.numBlocks * sizeof(IndexEntry) > bytes - sizeof(trailer)) {
+            munmap(mapped, bytes);
+            throw std::runtime_error(path + " is not a count file");
+        }
+        if (header[1] != (uint32_t)Traits::k || header[2] != sizeof(Key)) {
+            munmap(mapped, bytes);
+            throw std::runtime_error(path + " holds k = " + std::to_string(header[1]));
+        }
+        index.resize(trailer.numBlocks);
+        memcpy(index.data(), data + trailer.indexOffset, index.size() * sizeof(index[0]));
+    }
+
+    ~CountFileReader() {
+        if (data) munmap((void*)data, bytes);
+    }
+
+    CountFileReader(const CountFileReader&) = delete;
+    CountFileReader& operator=(const CountFileReader&) = delete;
+
+    size_t numBlocks() const { return index.size(); }
+    size_t size() const { return trailer.numRecords; }
+
+    // A block's index entry and its encoded bytes, to copy it undecoded
+    const IndexEntry& blockInfo(size_t b) const { return index[b]; }
+    const char* blockData(size_t b) const {
+        if (index[b].offset + index[b].bytes > trailer.indexOffset) {
+            throw std::runtime_error("Corrupt count file block");
+        }
+        return data + index[b].offset;
+    }
+
+    void readBlock(size_t b, std::vector<Record>& out) const {
+        const auto& entry = index[b];
+        const char* p = blockData(b);
+        const char* end = p + entry.bytes;
+
+        out.resize(entry.records);
+        Key key = 0;
+        for (uint32_t i = 0; i < entry.records; i++) {
+            Key delta;
+            p = getVarint(p, end, delta);
+            key = i == 0 ? delta : key + delta;
+            out[i].first = key;
+            p = getVarint(p, end, out[i].second);
+        }
+    }
+
+    // Count of one k-mer (0 if absent), decoding a single block
+    uint64_t lookup(Key key) const {
+        auto it = std::upper_bound(index.begin(), index.end(), key,
+                                   [](Key k, const IndexEntry& e) { return k < e.firstKey; });
+        if (it == index.begin()) return 0;
+        std::vector<Record> block;
+        readBlock(it - index.begin() - 1, block);
+        auto r = std::lower_bound(block.begin(), block.end(), Record{key, 0});
+        return (r != block.end() && r->first == key) ? r->second : 0;
+    }
+
+    // Calls f(key, count) for every record in key order
+    template <typename F>
+    void forEach(F f) const {
+        std::vector<Record> block;
+        for (size_t b = 0; b < index.size(); b++) {
+            readBlock(b, block);
+            for (const auto& r : block) f(r.first, r.second);
+        }
+    }
+};
+
+// Writes a count file with new counts added to those of an existing one.
+// Counts arrive in ascending key order; blocks of the old file that none
+// of them falls into are copied as they are, undecoded, so an update costs
+// about the new counts and the blocks they touch plus a copy of the rest.
+template <typename Traits>
+class CountFileUpdate {
+public:
+    using Key = typename Traits::Key;
+    using Record = std::pair<Key, uint64_t>;
+
+private:
+    const CountFileReader<Traits>& base;
+    CountFileWriter<Traits>& out;
+    size_t nextBlock = 0;        // first block of base not yet written
+    std::vector<Record> block;   // the decoded block the last key fell into
+    size_t pos = 0;              // its records not yet written start here
+    size_t decodedBlocks = 0;
+
+    // Writes decoded records below key, then the ones before the block key
+    // falls into, whole. True if key is left in the decoded block.
+    bool advanceTo(Key key) {
+        for (;;) {
+            while (pos < block.size() && block[pos].first < key) {
+                out.add(block[pos].first, block[pos].second);
+                pos++;
+            }
+            if (pos < block.size()) return true;
+
+            // Blocks that end before the next one's first key <= key
+            while (nextBlock + 1 < base.numBlocks() && base.blockInfo(nextBlock + 1).firstKey <= key) {
+                out.copyBlock(base.blockData(nextBlock), base.blockInfo(nextBlock));
+                nextBlock++;
+            }
+            if (nextBlock == base.numBlocks() || key < base.blockInfo(nextBlock).firstKey) return false;
+            base.readBlock(nextBlock++, block);
+            pos = 0;
+            decodedBlocks++;
+        }
+    }
+
+public:
+    CountFileUpdate(const CountFileReader<Traits>& b, CountFileWriter<Traits>& w) : base(b), out(w) {}
+
+    void add(Key key, uint64_t count) {
+        if (advanceTo(key) && block[pos].first == key) count += block[pos++].second;
+        out.add(key, count);
+    }
+
+    // Writes the rest of the old file; the writer still needs close()
+    void finish() {
+        for (; pos < block.size(); pos++) out.add(block[pos].first, block[pos].second);
+        for (; nextBlock < base.numBlocks(); nextBlock++) {
+            out.copyBlock(base.blockData(nextBlock), base.blockInfo(nextBlock));
+        }
+    }
+
+    size_t blocksDecoded() const { return decodedBlocks; }
+};
+
+#endif
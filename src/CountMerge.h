@@ -0,0 +1,186 @@
+#ifndef COUNT_MERGE_H
+#define COUNT_MERGE_H
+
+#include <string>
+#include <vector>
+#include <queue>
+#include <functional>
+#include <algorithm>
+#include <stdexcept>
+#include <cstdint>
+#include "CountFile.h"
+#include "ThreadPool.h"
+
+// Set operations over count files (CountFile.h) as a k-way merge of their
+// sorted records. The key space is cut into segments at block boundaries,
+// about one block per input each; segments are merged independently, a
+// batch of them in parallel, and handed on in key order. Each merge holds
+// one decoded block per input, so memory depends on the number of inputs
+// and threads, not on the size of the files.
+
+enum class SetOp { Union, Intersect, Difference };
+enum class CountOp { Sum, Min, Max };
+
+inline bool parseSetOp(const std::string& s, SetOp& op) {
+    if (s == "union") op = SetOp::Union;
+    else if (s == "intersect") op = SetOp::Intersect;
+    else if (s == "difference") op = SetOp::Difference;
+    else return false;
+    return true;
+}
+
+inline bool parseCountOp(const std::string& s, CountOp& op) {
+    if (s == "sum") op = CountOp::Sum;
+    else if (s == "min") op = CountOp::Min;
+    else if (s == "max") op = CountOp::Max;
+    else return false;
+    return true;
+}
+
+struct MergeOptions {
+    SetOp set = SetOp::Union;       // difference: in the first input and no other
+    CountOp combine = CountOp::Sum; // over the inputs a k-mer is present in
+    uint64_t inputMinCount = 1;     // lower counts in an input count as absent
+    size_t minInputs = 1;           // present in at least this many inputs
+    uint64_t minCount = 1;          // combined count in [minCount, maxCount]
+    uint64_t maxCount = UINT64_MAX;
+};
+
+template <typename Traits>
+class CountMerge {
+public:
+    using Key = typename Traits::Key;
+    using Record = std::pair<Key, uint64_t>;
+    using Reader = CountFileReader<Traits>;
+
+private:
+    std::vector<const Reader*> inputs;
+    MergeOptions opts;
+    // Segment s holds the keys in [bounds[s], bounds[s + 1]); the last one
+    // everything from its bound up
+    std::vector<Key> bounds;
+
+    // An input's records from one key on, a block at a time
+    struct Cursor {
+        const Reader* reader;
+        size_t block;
+        std::vector<Record> records;
+        size_t pos = 0;
+
+        Cursor(const Reader* r, Key from) : reader(r) {
+            // The last block starting at or before from
+            size_t lo = 0, hi = r->numBlocks();
+            while (lo < hi) {
+                size_t mid = (lo + hi) / 2;
+                if (from < r->blockInfo(mid).firstKey) hi = mid;
+                else lo = mid + 1;
+            }
+            block = lo ? lo - 1 : 0;
+            if (block < r->numBlocks()) {
+                r->readBlock(block, records);
+                pos = std::lower_bound(records.begin(), records.end(), Record{from, 0}) - records.begin();
+            }
+        }
+
+        // Has a record below end (or any, if unbounded)
+        bool valid(Key end, bool bounded) {
+            while (pos == records.size()) {
+                if (++block >= reader->numBlocks()) return false;
+                if (bounded && !(reader->blockInfo(block).firstKey < end)) return false;
+                reader->readBlock(block, records);
+                pos = 0;
+            }
+            return !bounded || records[pos].first < end;
+        }
+    };
+
+    // The combined count of one key, false if it is filtered out
+    bool combine(const std::vector<std::pair<size_t, uint64_t>>& present, uint64_t& count) const {
+        size_t n = present.size();
+        if (n == 0 || n < opts.minInputs) return false;
+        if (opts.set == SetOp::Intersect && n != inputs.size()) return false;
+        if (opts.set == SetOp::Difference && (n != 1 || present[0].first != 0)) return false;
+
+        count = present[0].second;
+        for (size_t i = 1; i < n; i++) {
+            uint64_t c = present[i].second;
+            switch (opts.combine) {
+                case CountOp::Sum: count = c > UINT64_MAX - count ? UINT64_MAX : count + c; break;
+                case CountOp::Min: count = std::min(count, c); break;
+                case CountOp::Max: count = std::max(count, c); break;
+            }
+        }
+        return count >= opts.minCount && count <= opts.maxCount;
+    }
+
+public:
+    CountMerge(std::vector<const Reader*> readers, const MergeOptions& options)
+        : inputs(std::move(readers)), opts(options) {
+        if (inputs.empty()) throw std::invalid_argument("CountMerge needs at least one input");
+        std::vector<Key> firstKeys;
+        for (const Reader* r : inputs) {
+            for (size_t b = 0; b < r->numBlocks(); b++) firstKeys.push_back(r->blockInfo(b).firstKey);
+        }
+        std::sort(firstKeys.begin(), firstKeys.end());
+        firstKeys.erase(std::unique(firstKeys.begin(), firstKeys.end()), firstKeys.end());
+        for (size_t i = 0; i < firstKeys.size(); i += inputs.size()) bounds.push_back(firstKeys[i]);
+    }
+
+    size_t numSegments() const { return bounds.size(); }
+
+    // Merged records of segment s, in key order
+    void mergeSegment(size_t s, std::vector<Record>& out) const {
+        out.clear();
+        Key from = bounds[s];
+        bool bounded = s + 1 < bounds.size();
+        Key end = bounded ? bounds[s + 1] : Key(0);
+
+        std::vector<Cursor> cursors;
+        cursors.reserve(inputs.size());
+        using Head = std::pair<Key, size_t>;
+        std::priority_queue<Head, std::vector<Head>, std::greater<Head>> heads;
+        for (size_t i = 0; i < inputs.size(); i++) {
+            cursors.emplace_back(inputs[i], from);
+            if (cursors[i].valid(end, bounded)) heads.push({cursors[i].records[cursors[i].pos].first, i});
+        }
+
+        std::vector<std::pair<size_t, uint64_t>> present;
+        while (!heads.empty()) {
+            Key key = heads.top().first;
+            present.clear();
+            while (!heads.empty() && heads.top().first == key) {
+                size_t i = heads.top().second;
+                heads.pop();
+                Cursor& c = cursors[i];
+                uint64_t count = c.records[c.pos++].second;
+                if (count >= opts.inputMinCount) present.push_back({i, count});
+                if (c.valid(end, bounded)) heads.push({c.records[c.pos].first, i});
+            }
+            // Inputs come off the heap in any order; difference needs the first
+            std::sort(present.begin(), present.end());
+            uint64_t count;
+            if (combine(present, count)) out.push_back({key, count});
+        }
+    }
+
+    // Calls emit(records) for every segment in key order; `threads` tasks
+    // merge a batch of two segments per thread at a time. Returns the
+    // number of records emitted.
+    size_t run(const std::function<void(const std::vector<Record>&)>& emit, unsigned threads,
+               TaskPool& pool = TaskPool::global()) const {
+        size_t batch = 2 * (size_t)std::max(1u, threads);
+        std::vector<std::vector<Record>> merged(std::min(batch, bounds.size()));
+        size_t total = 0;
+        for (size_t first = 0; first < bounds.size(); first += batch) {
+            size_t n = std::min(batch, bounds.size() - first);
+            pool.parallelFor(n, [&](size_t i) { mergeSegment(first + i, merged[i]); });
+            for (size_t i = 0; i < n; i++) {
+                emit(merged[i]);
+                total += merged[i].size();
+            }
+        }
+        return total;
+    }
+};
+
+#endif
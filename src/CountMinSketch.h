@@ -0,0 +1,72 @@
+#ifndef COUNT_MIN_SKETCH_H
+#define COUNT_MIN_SKETCH_H
+
+#include <atomic>
+#include <memory>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include "Kmer.h"
+
+// Count-min sketch shared by all workers: `depth` rows of `width` counters.
+// A key adds one to a counter in every row and its estimate is the smallest
+// of those counters, so estimates never undercount. With width = e / epsilon
+// and depth = ln(1 / delta), an estimate exceeds the true count by more than
+// epsilon * total with probability at most delta. Memory depends only on
+// epsilon and delta, not on the number of distinct keys.
+class CountMinSketch {
+    std::unique_ptr<std::atomic<uint64_t>[]> counters;
+    size_t width;
+    size_t depth;
+    double epsilon;
+
+    // Counter of every row for a hash, by double hashing: row r uses
+    // (start + r * step) % width
+    struct Probe {
+        uint64_t start, step;
+        explicit Probe(uint64_t hash)
+            : start(mix64(hash ^ 0x9e3779b97f4a7c15ULL)), step((start >> 32) | 1) {}
+    };
+
+    size_t cell(const Probe& p, size_t row) const {
+        return row * width + (size_t)((p.start + row * p.step) % width);
+    }
+
+public:
+    CountMinSketch(double epsilon, double delta)
+        : width((size_t)std::ceil(std::exp(1.0) / epsilon)),
+          depth((size_t)std::max(1.0, std::ceil(std::log(1.0 / delta)))),
+          epsilon(epsilon) {
+        counters.reset(new std::atomic<uint64_t>[width * depth]);
+        for (size_t i = 0; i < width * depth; i++) counters[i].store(0, std::memory_order_relaxed);
+    }
+
+    size_t bytes() const { return width * depth * sizeof(uint64_t); }
+    size_t rows() const { return depth; }
+    size_t columns() const { return width; }
+
+    void add(uint64_t hash) {
+        Probe p(hash);
+        for (size_t r = 0; r < depth; r++) counters[cell(p, r)].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    uint64_t estimate(uint64_t hash) const {
+        Probe p(hash);
+        uint64_t best = UINT64_MAX;
+        for (size_t r = 0; r < depth; r++) {
+            best = std::min(best, counters[cell(p, r)].load(std::memory_order_relaxed));
+        }
+        return best;
+    }
+
+    // Keys added so far (every key lands once in each row, so this is the
+    // sum of the first row), and the overestimate that holds with 1 - delta
+    uint64_t totalCount() const {
+        uint64_t total = 0;
+        for (size_t i = 0; i < width; i++) total += counters[i].load(std::memory_order_relaxed);
+        return total;
+    }
+    uint64_t errorBound() const { return (uint64_t)std::ceil(epsilon * totalCount()); }
+};
+
+#endif
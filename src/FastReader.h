@@ -0,0 +1,258 @@
+#ifndef FAST_READER_H
+#define FAST_READER_H
+
+#include <string>
+#include <vector>
+#include <queue>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <algorithm>
+#include <cstring>
+#include <glob.h>
+#include "data_structs.h"
+#include "InputStream.h"
+
+// Super simple version: just read 1 file into bundles. FASTA or FASTQ,
+// plain, gzip or BGZF compressed.
+class FastReader {
+    std::string path;
+    size_t blockSize;
+    size_t overlap;
+    unsigned decompressThreads;
+
+    std::unique_ptr<ByteSource> in;
+    std::vector<char> readBuffer;
+    size_t readPos = 0;
+    size_t readEnd = 0;
+    bool sniffed = false;
+    bool fastq = false;
+
+    std::string seqBuffer;
+    size_t carried = 0;  // bases at the front of seqBuffer already in the last bundle
+
+    bool getline(std::string& line) {
+        line.clear();
+        while (true) {
+            if (readPos == readEnd) {
+                readEnd = in->read(readBuffer.data(), readBuffer.size());
+                readPos = 0;
+                if (readEnd == 0) return !line.empty();
+            }
+            const char* start = readBuffer.data() + readPos;
+            const char* nl = (const char*)memchr(start, '\n', readEnd - readPos);
+            size_t n = nl ? nl - start : readEnd - readPos;
+            line.append(start, n);
+            readPos += n;
+            if (nl) {
+                readPos++;
+                if (!line.empty() && line.back() == '\r') line.pop_back();
+                return true;
+            }
+        }
+    }
+
+    void open() {
+        in = openInput(path, decompressThreads);
+        readBuffer.resize(1 << 20);
+        seqBuffer.reserve(blockSize * 2);
+    }
+
+public:
+    // Consecutive bundles share `overlap` bases (k - 1 for k-mer counting)
+    // so that no k-mer is lost at a bundle boundary
+    FastReader(std::string p, size_t bs = 1 << 20, size_t overlap = 0,  // default 1MB chunks
+               unsigned decompressThreads = 4)
+        : path(std::move(p)), blockSize(std::max(bs, overlap + 1)), overlap(overlap),
+          decompressThreads(decompressThreads) {}
+
+    // Streaming: fills the next bundle of up to blockSize bases and
+    // returns false once the file is exhausted
+    bool next(FastBundle& bundle) {
+        if (!in) open();
+
+        std::string line;
+        while (seqBuffer.size() < blockSize && getline(line)) {
+            if (line.empty()) continue;
+
+            if (!sniffed) {
+                fastq = line[0] == '@';
+                sniffed = true;
+            }
+            if (fastq) {
+                // 4-line records: @name, bases, +, qualities. Reads are
+                // separate sequences, so no k-mer may span two of them.
+                if (line[0] != '@') continue;
+                std::string plus, quality;
+                if (!getline(line) || !getline(plus) || !getline(quality)) break;
+                seqBuffer += line;
+                seqBuffer += RECORD_SEPARATOR;
+                continue;
+            }
+            if (line[0] == '>') {
+                // A new record: its lines continue a sequence only up to
+                // the next header
+                if (!seqBuffer.empty() && seqBuffer.back() != RECORD_SEPARATOR) seqBuffer += RECORD_SEPARATOR;
+                continue;
+            }
+
+            // Add DNA to buffer
+            seqBuffer += line;
+        }
+
+        if (seqBuffer.size() <= carried) return false;
+
+        size_t n = std::min(blockSize, seqBuffer.size());
+        bundle = FastBundle(n);
+        bundle.addBlock(seqBuffer.data(), n);
+        bundle.finalize();
+
+        size_t keep = std::min(overlap, n);
+        seqBuffer.erase(0, n - keep);
+        carried = keep;
+        return true;
+    }
+
+    std::vector<FastBundle> readFile() {
+        std::vector<FastBundle> bundles;
+        FastBundle bundle(0);
+        while (next(bundle)) {
+            bundles.push_back(std::move(bundle));
+        }
+        return bundles;
+    }
+};
+
+// Expands a comma-separated list of paths and glob patterns, in order. "-"
+// is stdin. A pattern with no matches is kept as is so opening it fails.
+inline std::vector<std::string> expandInputs(const std::string& spec) {
+    std::vector<std::string> paths;
+    size_t start = 0;
+    while (start <= spec.size()) {
+        size_t end = spec.find(',', start);
+        if (end == std::string::npos) end = spec.size();
+        std::string item = spec.substr(start, end - start);
+        start = end + 1;
+        if (item.empty()) continue;
+
+        if (item == "-" || item.find_first_of("*?[") == std::string::npos) {
+            paths.push_back(item);
+            continue;
+        }
+        glob_t matches;
+        if (glob(item.c_str(), GLOB_NOCHECK, nullptr, &matches) == 0) {
+            for (size_t i = 0; i < matches.gl_pathc; i++) paths.push_back(matches.gl_pathv[i]);
+        }
+        globfree(&matches);
+    }
+    return paths;
+}
+
+// One input of a ParallelReader: hands its bundles, in order, to the
+// emitter, which takes them and returns false once the reader is stopping
+using BundleEmitter = std::function<bool(FastBundle&)>;
+using BundleJob = std::function<void(const BundleEmitter&)>;
+
+// A job per file (or "-"), read with FastReader
+inline std::vector<BundleJob> fileJobs(const std::vector<std::string>& paths, size_t bundleSize, size_t overlap,
+                                       unsigned decompressThreads = 4) {
+    std::vector<BundleJob> jobs;
+    for (const auto& path : paths) {
+        jobs.push_back([=](const BundleEmitter& emit) {
+            FastReader reader(path, bundleSize, overlap, decompressThreads);
+            FastBundle bundle(0);
+            while (reader.next(bundle)) {
+                if (!emit(bundle)) return;
+            }
+        });
+    }
+    return jobs;
+}
+
+// Reads several inputs at once. Reader threads take the next input from a
+// shared list and push its bundles into a bounded queue, so a slow file or
+// pipe only holds up its own reader. Bundles come out in whatever order they
+// are ready; each input's bundles overlap as in FastReader, and bundles of
+// different inputs never share a k-mer.
+class ParallelReader {
+    std::vector<BundleJob> jobs;
+    size_t capacity;
+
+    std::atomic<size_t> nextJob{0};
+    std::vector<std::thread> readers;
+    unsigned running = 0;
+    bool stopping = false;
+    std::exception_ptr error;
+
+    std::mutex lock;
+    std::condition_variable notEmpty;
+    std::condition_variable notFull;
+    std::queue<FastBundle> bundles;
+
+    bool push(FastBundle& bundle) {
+        std::unique_lock<std::mutex> guard(lock);
+        notFull.wait(guard, [this]() { return bundles.size() < capacity || stopping; });
+        if (stopping) return false;
+        bundles.push(std::move(bundle));
+        notEmpty.notify_one();
+        return true;
+    }
+
+    void readLoop() {
+        BundleEmitter emit = [this](FastBundle& bundle) { return push(bundle); };
+        try {
+            for (size_t i; (i = nextJob++) < jobs.size();) {
+                jobs[i](emit);
+                std::lock_guard<std::mutex> guard(lock);
+                if (stopping) return;
+            }
+        } catch (...) {
+            std::lock_guard<std::mutex> guard(lock);
+            if (!error) error = std::current_exception();
+            stopping = true;
+            notFull.notify_all();
+        }
+        std::lock_guard<std::mutex> guard(lock);
+        running--;
+        notEmpty.notify_all();
+    }
+
+public:
+    // At most one reader per input; queue holds one bundle per reader
+    ParallelReader(std::vector<BundleJob> inputs, unsigned numReaders) : jobs(std::move(inputs)) {
+        unsigned n = std::max(1u, std::min<unsigned>(numReaders, jobs.size()));
+        capacity = n;
+        running = n;
+        for (unsigned i = 0; i < n; i++) readers.emplace_back(&ParallelReader::readLoop, this);
+    }
+
+    ~ParallelReader() {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stopping = true;
+        }
+        notFull.notify_all();
+        for (auto& t : readers) t.join();
+    }
+
+    unsigned numReaders() const { return readers.size(); }
+
+    // Next bundle from any input; false once every input is exhausted.
+    // Rethrows the first error a reader hit.
+    bool next(FastBundle& bundle) {
+        std::unique_lock<std::mutex> guard(lock);
+        notEmpty.wait(guard, [this]() { return !bundles.empty() || running == 0 || error; });
+        if (error) std::rethrow_exception(error);
+        if (bundles.empty()) return false;
+        bundle = std::move(bundles.front());
+        bundles.pop();
+        notFull.notify_one();
+        return true;
+    }
+};
+
+#endif
@@ -1,54 +1,359 @@
 #include "Hasher.h"
-#include <fstream>
+#include "SpillRun.h"
+#include "TextWriter.h"
+#include "CountFile.h"
+#include "SortCounter.h"
 #include <iostream>
+#include <algorithm>
+#include <memory>
+#include <cstdio>
+#include <thread>
+#include <stdexcept>
 
-Hasher::Hasher(std::queue<KmerBlock*>& queue, unsigned threads, size_t tableSize, size_t maxSteps)
-    : inputQueue(queue), numThreads(threads), workComplete(false) {
+template <typename Traits>
+BasicHasher<Traits>::BasicHasher(std::queue<Block*>& queue, unsigned threads, size_t tableSize, size_t maxSteps)
+    : inputQueue(queue), workerStats(threads), numThreads(threads), workComplete(false) {
     for (unsigned i = 0; i < numThreads; i++) {
-        threadTables.push_back(QuadraticHashTable(tableSize, maxSteps));
+        // Allocated by each worker, so its pages are local to the worker
+        threadTables.push_back(Table(tableSize, maxSteps, false));
     }
 }
 
-void Hasher::worker(unsigned threadId) {
-    QuadraticHashTable& table = threadTables[threadId];
+template <typename Traits>
+BasicHasher<Traits>::BasicHasher(unsigned threads, size_t tableSize, size_t maxSteps)
+    : BasicHasher(ownQueue, threads, tableSize, maxSteps) {
+    for (unsigned i = 0; i < numThreads; i++) {
+        workerQueues.push_back(std::make_unique<WorkerQueue>());
+    }
+}
+
+template <typename Traits>
+void BasicHasher<Traits>::setMemoryBudget(MemoryBudget* b, size_t bytesPerKey) {
+    budget = b;
+    keyBytes = bytesPerKey;
+    if (budget && !threadTables.empty()) {
+        size_t slots = 0;
+        for (const auto& table : threadTables) slots += table.capacity();
+        budget->acquire(MemStage::Tables, slots * (keyBytes + sizeof(size_t)));
+    }
+}
+
+template <typename Traits>
+void BasicHasher<Traits>::enableTopSketch(size_t capacity) {
+    sketches.assign(numThreads, SpaceSaving<Traits>(capacity));
+}
+
+template <typename Traits>
+void BasicHasher<Traits>::enableBloomFilter(size_t bytes) {
+    bloom = std::make_unique<BloomFilter>(bytes);
+    countBias = 1;
+}
+
+template <typename Traits>
+void BasicHasher<Traits>::enableApproximate(double epsilon, double delta) {
+    approxCounts = std::make_unique<CountMinSketch>(epsilon, delta);
+    if (budget) budget->charge(MemStage::Tables, approxCounts->bytes());
+}
+
+template <typename Traits>
+void BasicHasher<Traits>::enableSortEngine(const std::vector<bool>& partitions, size_t bufferKmers) {
+    sortPartitions = partitions;
+    sortBufferKmers = std::max<size_t>(1, bufferKmers);
+    sortBuffers.assign(numThreads, {});
+    sortedCounts.assign(numThreads, {});
+    for (auto& buffer : sortBuffers) buffer.reserve(sortBufferKmers);
+}
+
+template <typename Traits>
+void BasicHasher<Traits>::setPlacement(const std::vector<int>& cpus, bool hugePages) {
+    workerCpus = cpus;
+    for (auto& table : threadTables) table.setHugePages(hugePages);
+}
+
+template <typename Traits>
+void BasicHasher<Traits>::enableTableSpill(const std::string& dir) {
+    spillTables = true;
+    spillDir = dir;
+}
+
+template <typename Traits>
+void BasicHasher<Traits>::setSpillIO(const SpillIOSizes& sizes) {
+    spillIO = sizes;
+}
+
+template <typename Traits>
+void BasicHasher<Traits>::submit(unsigned threadId, Block* block) {
+    // Blocks the producer while the queued blocks are over budget
+    if (budget) {
+        uint64_t start = wallNs();
+        budget->acquire(MemStage::Queue, block->kmers.size() * keyBytes);
+        submitWaitNs += wallNs() - start;
+    }
+
+    WorkerQueue& q = *workerQueues[threadId];
+    bool schedule = false;
+    {
+        std::lock_guard<std::mutex> lock(q.lock);
+        q.blocks.push(block);
+        if (pool && !q.scheduled) schedule = q.scheduled = true;
+    }
+    if (schedule) strands->run([this, threadId]() { drain(threadId); });
+    else q.cv.notify_one();
+}
+
+// Next block for this worker, or nullptr once the input is exhausted
+template <typename Traits>
+typename BasicHasher<Traits>::Block* BasicHasher<Traits>::nextBlock(unsigned threadId) {
+    bool shared = workerQueues.empty();
+    std::mutex& mutex = shared ? queueLock : workerQueues[threadId]->lock;
+    std::condition_variable& ready = shared ? cv : workerQueues[threadId]->cv;
+    std::queue<Block*>& queue = shared ? inputQueue : workerQueues[threadId]->blocks;
+
+    std::unique_lock<std::mutex> lock(mutex);
+    if (queue.empty() && !workComplete) {
+        uint64_t start = wallNs();
+        ready.wait(lock, [this, &queue]() {
+            return !queue.empty() || workComplete;
+        });
+        workerStats[threadId].idleNs += wallNs() - start;
+    }
+
+    if (queue.empty()) return nullptr;
+    Block* block = queue.front();
+    queue.pop();
+    return block;
+}
+
+template <typename Traits>
+void BasicHasher<Traits>::worker(unsigned threadId) {
+    if (threadId < workerCpus.size()) pinCurrentThread(workerCpus[threadId]);
+    threadTables[threadId].allocate();
     
-    while (true) {
-        KmerBlock* block = nullptr;
+    while (Block* block = nextBlock(threadId)) processBlock(threadId, block);
+    finishWorker(threadId);
+}
+
+template <typename Traits>
+void BasicHasher<Traits>::runOn(TaskPool& taskPool) {
+    pool = &taskPool;
+    strands = std::make_unique<TaskGroup>(taskPool);
+}
+
+// One task's worth of a worker's queue, on whichever pool thread runs it.
+// Only one drain per worker is scheduled at a time, so the worker's table
+// is never touched by two threads at once.
+template <typename Traits>
+void BasicHasher<Traits>::drain(unsigned threadId) {
+    const int BLOCKS_PER_TASK = 16;
+    WorkerQueue& q = *workerQueues[threadId];
+    threadTables[threadId].allocate();
+
+    for (int i = 0; i < BLOCKS_PER_TASK; i++) {
+        Block* block;
         {
-            std::unique_lock<std::mutex> lock(queueLock);
-            cv.wait(lock, [this]() { 
-                return !inputQueue.empty() || workComplete; 
-            });
-            
-            if (!inputQueue.empty()) {
-                block = inputQueue.front();
-                inputQueue.pop();
-            } else if (workComplete && inputQueue.empty()) {
-                break;
+            std::lock_guard<std::mutex> lock(q.lock);
+            if (q.blocks.empty()) {
+                q.scheduled = false;
+                return;
             }
+            block = q.blocks.front();
+            q.blocks.pop();
+        }
+        processBlock(threadId, block);
+    }
+    // More to do: requeue behind other stages' tasks
+    strands->run([this, threadId]() { drain(threadId); });
+}
+
+template <typename Traits>
+void BasicHasher<Traits>::waitForWorkers() {
+    strands->wait();
+    pool->parallelFor(numThreads, [this](size_t t) { finishWorker(t); });
+}
+
+template <typename Traits>
+void BasicHasher<Traits>::processBlock(unsigned threadId, Block* block) {
+    uint64_t wall0 = wallNs(), cpu0 = threadCpuNs();
+    PerfSample perf0;
+    bool profiling = PerfCounters::enabled() && PerfCounters::thread().read(perf0);
+    Table& table = threadTables[threadId];
+    const Key* kmers = block->kmers.data();
+    if (sortBuffers.empty()) {
+        countKmers(table, threadId, kmers, kmers + block->kmers.size());
+    } else if (sortPartitions.empty()) {
+        sortKmers(threadId, kmers, kmers + block->kmers.size());
+    } else {
+        // Each partition goes to the engine picked for it
+        uint32_t begin = 0;
+        for (const auto& [partition, end] : block->segments) {
+            if (sortPartitions[partition]) sortKmers(threadId, kmers + begin, kmers + end);
+            else countKmers(table, threadId, kmers + begin, kmers + end);
+            begin = end;
         }
-        
-        if (block) {
-            for (const auto& kmer : block->kmers) {
-                if (!table.insert(kmer)) {
-                    // Insertion failed, add to overflow
-                    std::lock_guard<std::mutex> lock(overflowLock);
-                    overflow.push_back(kmer);
-                }
+        countKmers(table, threadId, kmers + begin, kmers + block->kmers.size());
+    }
+    if (budget && !workerQueues.empty()) {
+        budget->release(MemStage::Queue, block->kmers.size() * keyBytes);
+    }
+
+    uint64_t wall1 = wallNs(), cpu = threadCpuNs() - cpu0;
+    WorkerStats& stats = workerStats[threadId];
+    PerfSample perf;
+    if (profiling && PerfCounters::thread().read(perf)) {
+        perf -= perf0;
+        stats.perf += perf;
+        hashing.addPerf(perf);
+    }
+    stats.blocks++;
+    stats.kmers += block->kmers.size();
+    stats.busyNs += wall1 - wall0;
+    stats.cpuNs += cpu;
+    hashing.add(wall0, wall1, cpu);
+    hashing.count(0, block->kmers.size());
+    delete block;
+}
+
+// Each worker writes out its own last table, in parallel
+template <typename Traits>
+void BasicHasher<Traits>::finishWorker(unsigned threadId) {
+    if (!sortBuffers.empty()) flushSortBuffer(threadId);
+    if (spillTables) flushTable(threadTables[threadId]);
+}
+
+template <typename Traits>
+void BasicHasher<Traits>::countKmers(Table& table, unsigned threadId, const Key* begin, const Key* end) {
+    for (const Key* kmer = begin; kmer != end; kmer++) {
+        // A first sighting only goes into the filter
+        if (bloom && !bloom->testAndSet(Traits::hash(*kmer))) continue;
+
+        if (!sketches.empty()) {
+            // One-pass top-N: no table at all
+            sketches[threadId].add(*kmer);
+        } else if (approxCounts) {
+            approxCounts->add(Traits::hash(*kmer));
+        } else if (!table.insert(*kmer)) {
+            if (spillTables) {
+                // Table is saturated: write it out and start over
+                flushTable(table);
+                table.insert(*kmer);
+                workerStats[threadId].tableFlushes++;
+            } else {
+                // Insertion failed, add to overflow
+                addOverflow(*kmer);
+                workerStats[threadId].overflowed++;
             }
-            delete block;
         }
     }
 }
 
-void Hasher::mergeResults() {
+template <typename Traits>
+void BasicHasher<Traits>::sortKmers(unsigned threadId, const Key* begin, const Key* end) {
+    auto& buffer = sortBuffers[threadId];
+    while (begin != end) {
+        size_t n = std::min<size_t>(end - begin, sortBufferKmers - buffer.size());
+        buffer.insert(buffer.end(), begin, begin + n);
+        begin += n;
+        if (buffer.size() >= sortBufferKmers) flushSortBuffer(threadId);
+    }
+}
+
+// Sort and run-length count a worker's buffer, then fold the counts into
+// its sorted counts (or write them out as a run when spilling)
+template <typename Traits>
+void BasicHasher<Traits>::flushSortBuffer(unsigned threadId) {
+    auto& buffer = sortBuffers[threadId];
+    if (buffer.empty()) return;
+
+    std::vector<Key> scratch;
+    sortKeys<Traits>(buffer, scratch);
+    std::vector<std::pair<Key, uint64_t>> counts;
+    countRuns(buffer, counts);
+    buffer.clear();
+
+    if (spillTables) {
+        std::string path = makeTempPath(spillDir, "kmer_run_");
+        RunWriter<Traits> writer(path, spillIO, budget);
+        for (const auto& [key, count] : counts) writer.write(key, count);
+        writer.close();
+        addRun(path, writer.size());
+    } else {
+        mergeCounts(sortedCounts[threadId], counts);
+    }
+}
+
+template <typename Traits>
+void BasicHasher<Traits>::addRun(const std::string& path, size_t records) {
+    std::lock_guard<std::mutex> lock(runsLock);
+    runs.push_back(path);
+    spilledRecords += records;
+}
+
+template <typename Traits>
+void BasicHasher<Traits>::flushTable(Table& table) {
+    if (table.size() == 0) return;
+
+    std::string path = makeTempPath(spillDir, "kmer_run_");
+    RunWriter<Traits> writer(path, spillIO, budget);
+    table.forEachSorted([&](const Key& key, size_t count) { writer.write(key, count); });
+    writer.close();
+    table.clear();
+    addRun(path, writer.size());
+}
+
+template <typename Traits>
+void BasicHasher<Traits>::addOverflow(const Key& kmer) {
+    std::lock_guard<std::mutex> lock(overflowLock);
+    if (budget && !budget->tryAcquire(MemStage::Overflow, keyBytes)) {
+        spillOverflow();
+        budget->tryAcquire(MemStage::Overflow, keyBytes);
+    }
+    overflow.push_back(kmer);
+}
+
+// Count the overflow k-mers and write them out as a run. Caller holds
+// overflowLock.
+template <typename Traits>
+void BasicHasher<Traits>::spillOverflow() {
+    if (overflow.empty()) return;
+
+    std::sort(overflow.begin(), overflow.end());
+    std::string path = makeTempPath(spillDir, "kmer_run_");
+    RunWriter<Traits> writer(path, spillIO, budget);
+    for (size_t i = 0; i < overflow.size();) {
+        size_t j = i;
+        while (j < overflow.size() && overflow[j] == overflow[i]) j++;
+        writer.write(overflow[i], j - i);
+        i = j;
+    }
+    writer.close();
+    addRun(path, writer.size());
+
+    if (budget) budget->release(MemStage::Overflow, overflow.size() * keyBytes);
+    overflow.clear();
+    overflow.shrink_to_fit();
+}
+
+template <typename Traits>
+void BasicHasher<Traits>::mergeResults() {
     globalMap.clear();
+
+    if (spillTables) {
+        // Results stay on disk until streamResults() merges the runs
+        for (auto& table : threadTables) flushTable(table);
+        std::lock_guard<std::mutex> lock(overflowLock);
+        spillOverflow();
+        return;
+    }
     
     for (const auto& table : threadTables) {
         table.exportToMap(globalMap);
     }
+    for (auto& counts : sortedCounts) {
+        for (const auto& [k, c] : counts) globalMap[k] += c;
+        counts = {};
+    }
     
-    std::unordered_map<std::string, size_t> overflowCounts;
+    Map overflowCounts;
     for (const auto& k : overflow) {
         overflowCounts[k]++;
     }
@@ -57,24 +362,217 @@ void Hasher::mergeResults() {
         globalMap[k] += c;
     }
     
+    if (budget) budget->release(MemStage::Overflow, overflow.size() * keyBytes);
     overflow.clear();
+
+    // Read back spilled overflow
+    if (!runs.empty()) {
+        RunMerger<Traits>(runs, spillDir, spillIO, budget).merge([this](const Key& key, uint64_t count) {
+            globalMap[key] += count;
+        });
+        runs.clear();
+    }
+
+    if (countBias) {
+        for (auto& entry : globalMap) entry.second += countBias;
+    }
 }
 
-void Hasher::writeResults(std::string filename) {
-    std::ofstream out(filename);
+template <typename Traits>
+void BasicHasher<Traits>::streamResults(const std::function<void(const Key&, uint64_t)>& emit) {
+    if (spillTables) {
+        RunMerger<Traits>(runs, spillDir, spillIO, budget).merge([&](const Key& key, uint64_t count) {
+            emit(key, count + countBias);
+        });
+        runs.clear();
+        return;
+    }
     for (const auto& [kmer, count] : globalMap) {
-        out << kmer << '\t' << count << '\n';
+        emit(kmer, count);
+    }
+}
+
+template <typename Traits>
+size_t BasicHasher<Traits>::writeResults(std::string filename) {
+    if (!spillTables) return writeTextParallel<Traits>(globalMap, filename, numThreads, parallelPool());
+
+    // The runs come out of a single merge; format them in large buffers
+    ScopedCharge charge(budget, MemStage::SpillIO, spillIO.writerBytes());
+    AsyncOFStream out(filename, spillIO.writerSlots, spillIO.writerSlotBytes);
+    LineBuffer<Traits> lines;
+    size_t written = 0;
+    streamResults([&](const Key& kmer, uint64_t count) {
+        if (!lines.add(kmer, count)) {
+            out.write(lines.data(), lines.size());
+            lines.clear();
+            lines.add(kmer, count);
+        }
+        written++;
+    });
+    out.write(lines.data(), lines.size());
+    out.close();
+    if (!out) throw std::runtime_error("Could not write " + filename);
+    return written;
+}
+
+template <typename Traits>
+size_t BasicHasher<Traits>::writeCompressed(std::string filename, const std::string& basePath) {
+    if constexpr (!Traits::packed) {
+        throw std::runtime_error("Compressed output needs one of the k-specialized engines");
+    } else {
+        // An update is written next to the output and renamed over it, as
+        // the base is read while it is written and may be the output
+        std::unique_ptr<CountFileReader<Traits>> base;
+        if (!basePath.empty()) base = std::make_unique<CountFileReader<Traits>>(basePath);
+        std::string writePath = base ? filename + ".tmp" : filename;
+        std::unique_ptr<CountFileUpdate<Traits>> update;
+        ScopedCharge charge(budget, MemStage::SpillIO, spillIO.writerBytes());
+        CountFileWriter<Traits> writer(writePath, 4096, spillIO.writerSlots, spillIO.writerSlotBytes);
+        if (base) update = std::make_unique<CountFileUpdate<Traits>>(*base, writer);
+
+        if (spillTables) {
+            // Runs merge in key order already
+            streamResults([&](const Key& kmer, uint64_t count) {
+                if (update) update->add(kmer, count);
+                else writer.add(kmer, count);
+            });
+        } else {
+            std::vector<std::pair<Key, uint64_t>> entries(globalMap.begin(), globalMap.end());
+            sortParallel(entries, numThreads, parallelPool());
+            if (update) {
+                for (const auto& [kmer, count] : entries) update->add(kmer, count);
+            } else {
+                writer.addSorted(entries.data(), entries.size(), numThreads, parallelPool());
+            }
+        }
+        if (update) update->finish();
+        writer.close();
+        if (base && std::rename(writePath.c_str(), filename.c_str()) != 0) {
+            throw std::runtime_error("Could not replace " + filename);
+        }
+        return writer.size();
+    }
+}
+
+template <typename Traits>
+std::vector<uint64_t> BasicHasher<Traits>::histogram(size_t maxCount) {
+    std::vector<uint64_t> total(maxCount + 1, 0);
+    auto add = [maxCount](std::vector<uint64_t>& h, uint64_t count) {
+        h[std::min<uint64_t>(count, maxCount)]++;
+    };
+
+    if (spillTables || !disjointTables) {
+        // A k-mer may be split over tables or runs: count from the merge
+        mergeResults();
+        streamResults([&](const Key&, uint64_t count) { add(total, count); });
+        globalMap = Map();
+        return total;
+    }
+
+    std::vector<std::vector<uint64_t>> perThread(threadTables.size(), std::vector<uint64_t>(maxCount + 1, 0));
+    parallelPool().parallelFor(threadTables.size(), [&](size_t t) {
+        threadTables[t].forEach([&](const Key&, size_t count) { add(perThread[t], count + countBias); });
+        if (t < sortedCounts.size()) {
+            for (const auto& [k, c] : sortedCounts[t]) add(perThread[t], c + countBias);
+        }
+    });
+    for (const auto& h : perThread) {
+        for (size_t c = 0; c <= maxCount; c++) total[c] += h[c];
+    }
+
+    for (const auto& [k, c] : takeOverflowCounts()) add(total, c + countBias);
+    return total;
+}
+
+// Overflow k-mers failed to insert into their worker's table, so with
+// disjoint tables they are in no table; count them on their own (in memory
+// and spilled)
+template <typename Traits>
+typename BasicHasher<Traits>::Map BasicHasher<Traits>::takeOverflowCounts() {
+    Map counts;
+    for (const auto& k : overflow) counts[k]++;
+    if (budget) budget->release(MemStage::Overflow, overflow.size() * keyBytes);
+    overflow.clear();
+    if (!runs.empty()) {
+        RunMerger<Traits>(runs, spillDir, spillIO, budget).merge([&](const Key& key, uint64_t count) {
+            counts[key] += count;
+        });
+        runs.clear();
     }
+    return counts;
 }
 
-void Hasher::signalComplete() {
+template <typename Traits>
+std::vector<TopEntry<typename Traits::Key>> BasicHasher<Traits>::topN(size_t n) {
+    TopHeap<Key> top(n);
+
+    if (!sketches.empty()) {
+        // Sum the sketches (a key only splits across them if its partition
+        // moved, and the sum of overestimates is still an overestimate)
+        std::unordered_map<Key, TopEntry<Key>, typename Traits::KeyHash> merged;
+        for (const auto& sketch : sketches) {
+            for (const auto& e : sketch.entries()) {
+                auto& m = merged.try_emplace(e.key, TopEntry<Key>{e.key, 0, 0}).first->second;
+                m.count += e.count;
+                m.error += e.error;
+            }
+        }
+        for (const auto& [key, e] : merged) top.offer(key, e.count + countBias, e.error);
+        return top.take();
+    }
+
+    if (spillTables || !disjointTables) {
+        mergeResults();
+        streamResults([&](const Key& key, uint64_t count) { top.offer(key, count); });
+        globalMap = Map();
+        return top.take();
+    }
+
+    // A small heap per table, filled in parallel, then merged
+    std::vector<TopHeap<Key>> perThread(threadTables.size(), TopHeap<Key>(n));
+    parallelPool().parallelFor(threadTables.size(), [&](size_t t) {
+        threadTables[t].forEach([&](const Key& key, size_t count) {
+            perThread[t].offer(key, count + countBias);
+        });
+        if (t < sortedCounts.size()) {
+            for (const auto& [k, c] : sortedCounts[t]) perThread[t].offer(k, c + countBias);
+        }
+    });
+    for (auto& heap : perThread) {
+        for (const auto& e : heap.take()) top.offer(e.key, e.count);
+    }
+    for (const auto& [key, count] : takeOverflowCounts()) top.offer(key, count + countBias);
+    return top.take();
+}
+
+template <typename Traits>
+void BasicHasher<Traits>::signalComplete() {
     {
         std::lock_guard<std::mutex> lock(queueLock);
         workComplete = true;
     }
     cv.notify_all();
+
+    for (auto& q : workerQueues) {
+        // Taking the lock orders the flag with a worker's predicate check
+        { std::lock_guard<std::mutex> lock(q->lock); }
+        q->cv.notify_all();
+    }
 }
 
-const std::unordered_map<std::string, size_t>& Hasher::getResults() const {
+template <typename Traits>
+uint64_t BasicHasher<Traits>::lookup(const Key& kmer) const {
+    if (approxCounts) return approxCounts->estimate(Traits::hash(kmer));
+    auto it = globalMap.find(kmer);
+    return it == globalMap.end() ? 0 : it->second;
+}
+
+template <typename Traits>
+const typename BasicHasher<Traits>::Map& BasicHasher<Traits>::getResults() const {
     return globalMap;
-}
\ No newline at end of file
+}
+
+template class BasicHasher<StringKmerTraits>;
+#define INSTANTIATE_HASHER(K) template class BasicHasher<PackedKmerTraits<K>>;
+KMER_SPECIALIZATIONS(INSTANTIATE_HASHER)
+#undef INSTANTIATE_HASHER
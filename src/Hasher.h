@@ -7,35 +7,230 @@
 #include <condition_variable>
 #include <unordered_map>
 #include <string>
+#include <memory>
+#include <atomic>
+#include <functional>
 #include "QuadraticHashTable.h"
 #include "data_structs.h"
+#include "MemoryBudget.h"
+#include "TopN.h"
+#include "BloomFilter.h"
+#include "CountMinSketch.h"
+#include "ThreadPool.h"
+#include "StageStats.h"
+
+// Instantiated in Hasher.cpp for StringKmerTraits and for every
+// PackedKmerTraits<K> listed in KMER_SPECIALIZATIONS.
+template <typename Traits>
+class BasicHasher {
+public:
+    using Key = typename Traits::Key;
+    using Block = BasicKmerBlock<Key>;
+    using Table = BasicQuadraticHashTable<Traits>;
+    using Map = typename Table::Map;
 
-class Hasher {
 private:
-    std::queue<KmerBlock*>& inputQueue;
+    // Per-worker queue, used when blocks are routed to a specific worker
+    struct WorkerQueue {
+        std::mutex lock;
+        std::condition_variable cv;
+        std::queue<Block*> blocks;
+        bool scheduled = false;  // a drain task is queued or running (pool mode)
+    };
+
+    std::queue<Block*> ownQueue;
+    std::queue<Block*>& inputQueue;
     std::mutex queueLock;
     std::condition_variable cv;
+    std::vector<std::unique_ptr<WorkerQueue>> workerQueues;  // empty in shared-queue mode
     
-    std::unordered_map<std::string, size_t> globalMap;
+    Map globalMap;
     
     // Overflow handling
-    std::vector<std::string> overflow;
+    std::vector<Key> overflow;
     std::mutex overflowLock;
+
+    // Memory accounting (optional). When the overflow share of the budget
+    // is used up, overflow is counted and spilled as a run.
+    MemoryBudget* budget = nullptr;
+    size_t keyBytes = sizeof(Key);
+
+    // Spill runs: sorted (k-mer, count) files on disk. In table-spill mode
+    // a table that fills up is flushed as a run and cleared, and results
+    // come from a streaming merge of all runs.
+    bool spillTables = false;
+    std::string spillDir;
+    SpillIOSizes spillIO;  // run buffers, charged to the budget if set
+    std::vector<std::string> runs;
+    std::mutex runsLock;
+    size_t spilledRecords = 0;
+
+    // No k-mer is in more than one thread table (each k-mer only ever went
+    // to one worker), so tables can be scanned without merging them
+    bool disjointTables = false;
+
+    // One-pass approximate top-N: per-worker Space-Saving sketches take
+    // the place of the tables (empty unless enabled)
+    std::vector<SpaceSaving<Traits>> sketches;
+
+    // BFCounter-style pre-pass: a k-mer enters the tables on its second
+    // sighting, so stored counts miss the first one and are reported
+    // countBias (1) higher
+    std::unique_ptr<BloomFilter> bloom;
+    uint64_t countBias = 0;
+
+    // Approximate backend: one count-min sketch shared by all workers in
+    // place of the tables (null unless enabled)
+    std::unique_ptr<CountMinSketch> approxCounts;
+
+    // Sort engine: k-mers of the partitions marked in sortPartitions (all
+    // of them if it is empty) are buffered per worker and counted by
+    // sorting, into per-worker sorted counts disjoint from the tables
+    std::vector<bool> sortPartitions;
+    size_t sortBufferKmers = 0;
+    std::vector<std::vector<Key>> sortBuffers;  // empty unless enabled
+    std::vector<std::vector<std::pair<Key, uint64_t>>> sortedCounts;
+    
+    // Pool mode: workers are drain tasks on a task pool instead of threads
+    TaskPool* pool = nullptr;
+    std::unique_ptr<TaskGroup> strands;
+    
+    // CPU each worker pins itself to (empty: no pinning)
+    std::vector<int> workerCpus;
+    
+public:
+    // Per-worker counters for --stats; each is only written by its worker
+    struct alignas(64) WorkerStats {
+        uint64_t blocks = 0;
+        uint64_t kmers = 0;
+        uint64_t busyNs = 0;        // processing blocks, wall
+        uint64_t cpuNs = 0;         // processing blocks, thread CPU
+        uint64_t idleNs = 0;        // waiting for a block (dedicated threads)
+        uint64_t tableFlushes = 0;  // full tables written out as runs
+        uint64_t overflowed = 0;    // k-mers that went to the overflow
+        PerfSample perf;            // hardware counters while processing (--perf)
+    };
+
+private:
+    std::vector<WorkerStats> workerStats;
+    StageClock hashing;
+    std::atomic<uint64_t> submitWaitNs{0};
     
     unsigned numThreads;
-    bool workComplete;
+    std::atomic<bool> workComplete;
+
+    Block* nextBlock(unsigned threadId);
+    void drain(unsigned threadId);
+    void processBlock(unsigned threadId, Block* block);
+    void finishWorker(unsigned threadId);
+    TaskPool& parallelPool() { return pool ? *pool : TaskPool::global(); }
+    void countKmers(Table& table, unsigned threadId, const Key* begin, const Key* end);
+    void sortKmers(unsigned threadId, const Key* begin, const Key* end);
+    void flushSortBuffer(unsigned threadId);
+    void addOverflow(const Key& kmer);
+    void spillOverflow();
+    void flushTable(Table& table);
+    void addRun(const std::string& path, size_t records);
+    Map takeOverflowCounts();
 
 public:
-    std::vector<QuadraticHashTable> threadTables;  // Made public for debugging access
+    std::vector<Table> threadTables;  // Made public for debugging access
     
-    Hasher(std::queue<KmerBlock*>& queue, unsigned threads, size_t tableSize, size_t maxSteps);
+    // Shared-queue mode: every worker pulls from the caller's queue
+    BasicHasher(std::queue<Block*>& queue, unsigned threads, size_t tableSize, size_t maxSteps);
+
+    // Routed mode: each worker has its own queue, fed through submit()
+    BasicHasher(unsigned threads, size_t tableSize, size_t maxSteps);
+    
+    // Charge tables, queued blocks and overflow against a budget; keyBytes
+    // is the footprint of one k-mer (Traits::keyBytes(k))
+    void setMemoryBudget(MemoryBudget* budget, size_t keyBytes);
+    
+    // Pin worker i to cpus[i] (no pinning if empty) and back the tables
+    // with huge pages. Call before the workers start; each worker then
+    // allocates its own table after pinning, so the pages are node-local.
+    void setPlacement(const std::vector<int>& cpus, bool hugePages);
+    
+    // Flush full tables to sorted runs in dir (default $TMPDIR) instead of
+    // using the overflow vector, so counting fits in the fixed table size
+    void enableTableSpill(const std::string& dir = "");
+
+    // Buffer sizes and merge fan-in for spill runs (MemoryPlan::spillIO)
+    void setSpillIO(const SpillIOSizes& sizes);
+    
+    // Keep k-mers out of the tables until their second sighting, using a
+    // Bloom filter of about `bytes`. Singletons are dropped (except for
+    // false positives, reported with count 2).
+    void enableBloomFilter(size_t bytes);
+    
+    // Count into a count-min sketch instead of the tables: estimates
+    // overcount by at most epsilon * total k-mers with probability
+    // 1 - delta, in memory independent of the number of distinct k-mers.
+    // Results only come from lookup().
+    void enableApproximate(double epsilon, double delta);
+    const CountMinSketch* getApproximate() const { return approxCounts.get(); }
+    
+    // Count by sorting instead of hashing: every partition if `partitions`
+    // is empty, else those marked true (blocks must then carry segments).
+    // Each worker sorts and run-length counts a buffer of bufferKmers.
+    void enableSortEngine(const std::vector<bool>& partitions, size_t bufferKmers);
+    bool sortsByPartition() const { return !sortPartitions.empty(); }
     
+    // Workers count into Space-Saving sketches of `capacity` counters
+    // instead of tables; only topN() gives results
+    void enableTopSketch(size_t capacity);
+
+    // Set when every k-mer was routed to a single worker for the whole run
+    void setDisjointTables(bool disjoint) { disjointTables = disjoint; }
+    
+    void submit(unsigned threadId, Block* block);
     void worker(unsigned threadId);
+
+    // Routed mode without worker threads: each submitted block schedules
+    // its worker's queue to be drained by a task on the pool, so pool
+    // threads move between hashing and whatever else runs there. After
+    // signalComplete(), waitForWorkers() takes the place of joining.
+    void runOn(TaskPool& pool);
+    void waitForWorkers();
     void mergeResults();
-    void writeResults(std::string filename);
+    size_t writeResults(std::string filename);
+    // Compressed, block-indexed binary output (CountFile.h); packed k-mers
+    // only. With a base file, writes its counts plus these (base may be
+    // filename; the output replaces it once complete).
+    size_t writeCompressed(std::string filename, const std::string& basePath = "");
     void signalComplete();
+
+    // Abundance histogram instead of results: h[c] = number of distinct
+    // k-mers seen c times, with everything >= maxCount in h[maxCount].
+    // Call instead of mergeResults(). With disjoint tables each worker's
+    // table is scanned in parallel and no results map is built.
+    std::vector<uint64_t> histogram(size_t maxCount);
+
+    // The n most frequent k-mers, best first, without building a results
+    // map when tables are disjoint. Call instead of mergeResults().
+    std::vector<TopEntry<Key>> topN(size_t n);
     
-    const std::unordered_map<std::string, size_t>& getResults() const;
+    // Every (k-mer, count) after mergeResults(). In table-spill mode this
+    // is a one-shot merge of the runs, in ascending k-mer order.
+    void streamResults(const std::function<void(const Key&, uint64_t)>& emit);
+
+    // Count of one k-mer: the sketch estimate in approximate mode,
+    // otherwise from the merged map (after mergeResults(), not in
+    // table-spill mode)
+    uint64_t lookup(const Key& kmer) const;
+
+    // In table-spill mode the map stays empty; use streamResults()
+    const Map& getResults() const;
+    // Instrumentation, once the workers are done: every processed block
+    // is timed into hashStage(), and submitWaitNs() is the time producers
+    // spent blocked on a full queue budget
+    const std::vector<WorkerStats>& getWorkerStats() const { return workerStats; }
+    const StageClock& hashStage() const { return hashing; }
+    uint64_t getSubmitWaitNs() const { return submitWaitNs; }
+    size_t getSpilledRuns() const { return runs.size(); }
+    size_t getSpilledRecords() const { return spilledRecords; }
 };
 
-#endif
\ No newline at end of file
+using Hasher = BasicHasher<StringKmerTraits>;
+
+#endif
@@ -0,0 +1,394 @@
+#ifndef INPUT_STREAM_H
+#define INPUT_STREAM_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <zlib.h>
+#include "AsyncIO.h"
+
+// Raw bytes of an input, already decompressed
+class ByteSource {
+public:
+    virtual ~ByteSource() = default;
+
+    // Fills up to n bytes; 0 at end of input
+    virtual size_t read(char* buf, size_t n) = 0;
+};
+
+// A file or stdin ("-"). Regular files are read ahead asynchronously,
+// pipes with read(2). The first bytes can be peeked to sniff the format.
+class FileSource : public ByteSource {
+    int fd;
+    bool owned;
+    std::unique_ptr<AsyncReader> async;
+    std::string peeked;
+    size_t peekPos = 0;
+
+    size_t readFd(char* buf, size_t n) {
+        if (async) return async->read(buf, n);
+        while (true) {
+            ssize_t got = ::read(fd, buf, n);
+            if (got >= 0) return (size_t)got;
+            if (errno != EINTR) throw std::runtime_error("Read error: " + std::string(strerror(errno)));
+        }
+    }
+
+public:
+    explicit FileSource(const std::string& path) {
+        owned = path != "-";
+        fd = owned ? ::open(path.c_str(), O_RDONLY) : 0;
+        if (fd < 0) throw std::runtime_error("Could not open file: " + path);
+
+        struct stat st;
+        if (owned && fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+            async = std::make_unique<AsyncReader>(path);
+        }
+    }
+
+    ~FileSource() override {
+        if (owned) ::close(fd);
+    }
+
+    // Up to n bytes from the start of the input, without consuming them
+    const std::string& peek(size_t n) {
+        while (peeked.size() < n) {
+            char buf[256];
+            size_t got = readFd(buf, std::min(sizeof(buf), n - peeked.size()));
+            if (got == 0) break;
+            peeked.append(buf, got);
+        }
+        return peeked;
+    }
+
+    size_t read(char* buf, size_t n) override {
+        if (peekPos < peeked.size()) {
+            size_t c = std::min(n, peeked.size() - peekPos);
+            memcpy(buf, peeked.data() + peekPos, c);
+            peekPos += c;
+            return c;
+        }
+        return readFd(buf, n);
+    }
+};
+
+// Decompressed chunks handed from decompression threads to the parser in
+// sequence order. At most `window` chunks are in flight, so a parser that
+// falls behind throttles decompression.
+class OrderedChunks {
+    std::mutex lock;
+    std::condition_variable ready;
+    std::condition_variable space;
+    std::map<size_t, std::vector<char>> chunks;
+    size_t window;
+    size_t issued = 0;
+    size_t taken = 0;
+    size_t total = SIZE_MAX;  // known once the producer is done
+    bool stopping = false;
+    std::exception_ptr error;
+
+public:
+    explicit OrderedChunks(size_t window) : window(window) {}
+
+    // Sequence number for the next chunk; blocks while the window is full.
+    // Returns false if the consumer has gone away.
+    bool reserve(size_t& seq) {
+        std::unique_lock<std::mutex> guard(lock);
+        space.wait(guard, [this]() { return issued - taken < window || stopping; });
+        if (stopping) return false;
+        seq = issued++;
+        return true;
+    }
+
+    void put(size_t seq, std::vector<char> data) {
+        std::lock_guard<std::mutex> guard(lock);
+        chunks[seq] = std::move(data);
+        ready.notify_all();
+    }
+
+    void finish() {
+        std::lock_guard<std::mutex> guard(lock);
+        total = issued;
+        ready.notify_all();
+    }
+
+    void fail(std::exception_ptr e) {
+        std::lock_guard<std::mutex> guard(lock);
+        if (!error) error = e;
+        ready.notify_all();
+    }
+
+    // Next chunk in order; false at end. Rethrows a producer's error.
+    bool take(std::vector<char>& out) {
+        std::unique_lock<std::mutex> guard(lock);
+        ready.wait(guard, [this]() { return error || taken == total || chunks.count(taken); });
+        if (error) std::rethrow_exception(error);
+        if (taken == total) return false;
+        out = std::move(chunks[taken]);
+        chunks.erase(taken++);
+        space.notify_all();
+        return true;
+    }
+
+    void stop() {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+        space.notify_all();
+    }
+};
+
+// Reads from a queue of decompressed chunks
+class ChunkedSource : public ByteSource {
+    std::vector<char> chunk;
+    size_t pos = 0;
+
+protected:
+    OrderedChunks chunks;
+
+public:
+    explicit ChunkedSource(size_t window) : chunks(window) {}
+
+    size_t read(char* buf, size_t n) override {
+        while (pos == chunk.size()) {
+            if (!chunks.take(chunk)) return 0;
+            pos = 0;
+        }
+        size_t c = std::min(n, chunk.size() - pos);
+        memcpy(buf, chunk.data() + pos, c);
+        pos += c;
+        return c;
+    }
+};
+
+// Plain gzip (any number of concatenated members). Inflating is serial, but
+// runs on its own thread ahead of the parser.
+class GzipSource : public ChunkedSource {
+    static constexpr size_t CHUNK = 1 << 20;
+
+    std::unique_ptr<FileSource> file;
+    std::thread inflater;
+
+    void run() {
+        z_stream zs{};
+        try {
+            if (inflateInit2(&zs, 16 + MAX_WBITS) != Z_OK) throw std::runtime_error("inflateInit failed");
+            std::vector<char> in(CHUNK);
+            bool eof = false;
+            bool inMember = false;
+            size_t seq;
+            while (chunks.reserve(seq)) {
+                std::vector<char> out(CHUNK);
+                zs.next_out = (Bytef*)out.data();
+                zs.avail_out = CHUNK;
+                while (zs.avail_out > 0) {
+                    if (zs.avail_in == 0 && !eof) {
+                        zs.avail_in = file->read(in.data(), CHUNK);
+                        zs.next_in = (Bytef*)in.data();
+                        eof = zs.avail_in == 0;
+                    }
+                    if (zs.avail_in == 0) {
+                        if (inMember) throw std::runtime_error("Truncated gzip input");
+                        break;
+                    }
+                    int ret = inflate(&zs, Z_NO_FLUSH);
+                    if (ret == Z_STREAM_END) {
+                        inflateReset(&zs);  // another member may follow
+                        inMember = false;
+                    } else if (ret == Z_OK || ret == Z_BUF_ERROR) {
+                        inMember = true;
+                    } else {
+                        throw std::runtime_error("Corrupt gzip input");
+                    }
+                }
+                out.resize(CHUNK - zs.avail_out);
+                bool last = out.empty();
+                chunks.put(seq, std::move(out));
+                if (last) break;
+            }
+            chunks.finish();
+        } catch (...) {
+            chunks.fail(std::current_exception());
+        }
+        inflateEnd(&zs);
+    }
+
+public:
+    explicit GzipSource(std::unique_ptr<FileSource> f)
+        : ChunkedSource(4), file(std::move(f)) {
+        inflater = std::thread(&GzipSource::run, this);
+    }
+
+    ~GzipSource() override {
+        chunks.stop();
+        inflater.join();
+    }
+};
+
+// BGZF (bgzip, BAM and most sequencer output): a series of independent gzip
+// members of at most 64 KB each, whose size is stored in a "BC" header
+// field. One thread cuts the input into blocks, a pool inflates them in
+// parallel, and the parser gets them back in order.
+class BgzfSource : public ChunkedSource {
+    struct Block {
+        size_t seq;
+        std::vector<char> data;
+    };
+
+    std::unique_ptr<FileSource> file;
+    std::thread splitter;
+    std::vector<std::thread> workers;
+
+    std::mutex jobsLock;
+    std::condition_variable jobsReady;
+    std::vector<Block> jobs;
+    bool splitDone = false;
+
+    bool readFully(char* buf, size_t n) {
+        size_t got = 0;
+        while (got < n) {
+            size_t r = file->read(buf + got, n - got);
+            if (r == 0) {
+                if (got == 0) return false;
+                throw std::runtime_error("Truncated BGZF block");
+            }
+            got += r;
+        }
+        return true;
+    }
+
+    // Next whole compressed block, or false at end of input
+    bool nextBlock(std::vector<char>& block) {
+        char header[12];
+        if (!readFully(header, sizeof(header))) return false;
+        if ((uint8_t)header[0] != 0x1f || (uint8_t)header[1] != 0x8b || !(header[3] & 4)) {
+            throw std::runtime_error("Not a BGZF block");
+        }
+        size_t xlen = (uint8_t)header[10] | (uint8_t)header[11] << 8;
+        std::vector<char> extra(xlen);
+        readFully(extra.data(), xlen);
+
+        size_t blockSize = 0;
+        for (size_t i = 0; i + 4 <= xlen;) {
+            size_t slen = (uint8_t)extra[i + 2] | (uint8_t)extra[i + 3] << 8;
+            if (extra[i] == 'B' && extra[i + 1] == 'C' && slen == 2 && i + 6 <= xlen) {
+                blockSize = ((uint8_t)extra[i + 4] | (uint8_t)extra[i + 5] << 8) + 1;
+            }
+            i += 4 + slen;
+        }
+        if (blockSize < 12 + xlen + 8) throw std::runtime_error("Bad BGZF block size");
+
+        block.resize(blockSize);
+        memcpy(block.data(), header, sizeof(header));
+        memcpy(block.data() + sizeof(header), extra.data(), xlen);
+        readFully(block.data() + 12 + xlen, blockSize - 12 - xlen);
+        return true;
+    }
+
+    static std::vector<char> inflateBlock(const std::vector<char>& block) {
+        size_t xlen = (uint8_t)block[10] | (uint8_t)block[11] << 8;
+        const uint8_t* trailer = (const uint8_t*)block.data() + block.size() - 8;
+        uint32_t crc = trailer[0] | trailer[1] << 8 | trailer[2] << 16 | (uint32_t)trailer[3] << 24;
+        uint32_t isize = trailer[4] | trailer[5] << 8 | trailer[6] << 16 | (uint32_t)trailer[7] << 24;
+
+        // One spare byte so inflate can reach the end of an empty block
+        std::vector<char> out(isize + 1);
+        z_stream zs{};
+        inflateInit2(&zs, -MAX_WBITS);  // raw deflate data
+        zs.next_in = (Bytef*)block.data() + 12 + xlen;
+        zs.avail_in = block.size() - 12 - xlen - 8;
+        zs.next_out = (Bytef*)out.data();
+        zs.avail_out = isize + 1;
+        int ret = inflate(&zs, Z_FINISH);
+        inflateEnd(&zs);
+        out.resize(isize);
+
+        if (ret != Z_STREAM_END || zs.total_out != isize ||
+            crc32(0, (const Bytef*)out.data(), isize) != crc) {
+            throw std::runtime_error("Corrupt BGZF block");
+        }
+        return out;
+    }
+
+    void split() {
+        try {
+            std::vector<char> block;
+            size_t seq;
+            while (chunks.reserve(seq)) {
+                if (!nextBlock(block)) {
+                    chunks.put(seq, {});
+                    chunks.finish();
+                    break;
+                }
+                std::lock_guard<std::mutex> guard(jobsLock);
+                jobs.push_back({seq, std::move(block)});
+                jobsReady.notify_one();
+            }
+        } catch (...) {
+            chunks.fail(std::current_exception());
+        }
+        std::lock_guard<std::mutex> guard(jobsLock);
+        splitDone = true;
+        jobsReady.notify_all();
+    }
+
+    void inflateLoop() {
+        while (true) {
+            Block job;
+            {
+                std::unique_lock<std::mutex> guard(jobsLock);
+                jobsReady.wait(guard, [this]() { return !jobs.empty() || splitDone; });
+                if (jobs.empty()) return;
+                job = std::move(jobs.back());
+                jobs.pop_back();
+            }
+            try {
+                chunks.put(job.seq, inflateBlock(job.data));
+            } catch (...) {
+                chunks.fail(std::current_exception());
+            }
+        }
+    }
+
+public:
+    BgzfSource(std::unique_ptr<FileSource> f, unsigned threads)
+        : ChunkedSource(8 * std::max(1u, threads)), file(std::move(f)) {
+        splitter = std::thread(&BgzfSource::split, this);
+        for (unsigned i = 0; i < std::max(1u, threads); i++) {
+            workers.emplace_back(&BgzfSource::inflateLoop, this);
+        }
+    }
+
+    ~BgzfSource() override {
+        chunks.stop();
+        splitter.join();
+        for (auto& t : workers) t.join();
+    }
+};
+
+// Opens a file or "-" and picks plain, gzip or BGZF by its magic bytes.
+// BGZF blocks are inflated on decompressThreads threads.
+inline std::unique_ptr<ByteSource> openInput(const std::string& path, unsigned decompressThreads = 4) {
+    auto file = std::make_unique<FileSource>(path);
+    const std::string& magic = file->peek(14);
+    if (magic.size() >= 2 && (uint8_t)magic[0] == 0x1f && (uint8_t)magic[1] == 0x8b) {
+        bool bgzf = magic.size() >= 14 && (magic[3] & 4) && magic[12] == 'B' && magic[13] == 'C';
+        if (bgzf) return std::make_unique<BgzfSource>(std::move(file), decompressThreads);
+        return std::make_unique<GzipSource>(std::move(file));
+    }
+    return file;
+}
+
+#endif
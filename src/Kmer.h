@@ -0,0 +1,162 @@
+#ifndef KMER_H
+#define KMER_H
+
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <functional>
+#include <type_traits>
+#include <istream>
+#include <ostream>
+
+// Values of k that get a compile-time specialized counting engine. Anything
+// else goes through the generic (string keyed) engine.
+#define KMER_SPECIALIZATIONS(X) X(21) X(25) X(31) X(51) X(63)
+
+// 2-bit base codes: A=0, C=1, G=2, T=3, anything else = 4 (invalid)
+inline uint8_t baseCode(char c) {
+    switch (c) {
+        case 'A': case 'a': return 0;
+        case 'C': case 'c': return 1;
+        case 'G': case 'g': return 2;
+        case 'T': case 't': return 3;
+        default: return 4;
+    }
+}
+
+// Soft-masked (lowercase) bases count as their uppercase base. baseCode
+// already maps both cases to one code; string k-mers go through this.
+inline void upperCaseBases(std::string& seq) {
+    for (char& c : seq) {
+        if (c >= 'a' && c <= 'z') c -= 'a' - 'A';
+    }
+}
+
+inline uint64_t mix64(uint64_t x) {
+    // murmur3 finalizer
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+// Generic engine: k-mers are kept as plain strings, k is a runtime value
+struct StringKmerTraits {
+    static constexpr bool packed = false;
+    using Key = std::string;
+    using KeyHash = std::hash<std::string>;
+
+    static Key emptyKey() { return ""; }
+    static bool isEmpty(const Key& key) { return key.empty(); }
+    static uint64_t hash(const Key& key) { return KeyHash{}(key); }
+    static std::string toString(const Key& key) { return key; }
+    static Key fromString(std::string s) {
+        upperCaseBases(s);
+        return s;
+    }
+
+    // Text form without a temporary string: length, and write at out
+    static size_t textSize(const Key& key) { return key.size(); }
+    static char* formatKey(char* out, const Key& key) {
+        memcpy(out, key.data(), key.size());
+        return out + key.size();
+    }
+
+    // Memory held by one k-mer of length k (the string plus its heap
+    // buffer once it outgrows the small-string buffer)
+    static size_t keyBytes(int k) { return sizeof(Key) + (k > 15 ? k + 1 : 0); }
+
+    // Binary form used in spill runs: 32-bit length, then the bases
+    static void writeKey(std::ostream& out, const Key& key) {
+        uint32_t n = key.size();
+        out.write(reinterpret_cast<const char*>(&n), sizeof(n));
+        out.write(key.data(), n);
+    }
+
+    static bool readKey(std::istream& in, Key& key) {
+        uint32_t n;
+        if (!in.read(reinterpret_cast<char*>(&n), sizeof(n))) return false;
+        key.resize(n);
+        return (bool)in.read(&key[0], n);
+    }
+};
+
+// Specialized engine: k-mers are packed 2 bits per base into the smallest
+// word that fits, so masks and shifts are constants in the inner loops.
+// The top bits of the word are never used, so all-ones marks an empty slot.
+template <int K>
+struct PackedKmerTraits {
+    static_assert(K > 0 && K <= 63, "packed k-mers support k <= 63");
+
+    static constexpr bool packed = true;
+    static constexpr int k = K;
+    static constexpr int BITS = 2 * K;
+    using Key = typename std::conditional<(K <= 31), uint64_t, unsigned __int128>::type;
+
+    static constexpr Key MASK = (Key(1) << BITS) - 1;
+    static constexpr Key EMPTY = ~Key(0);
+
+    struct KeyHash {
+        size_t operator()(Key key) const { return PackedKmerTraits::hash(key); }
+    };
+
+    static Key emptyKey() { return EMPTY; }
+    static bool isEmpty(Key key) { return key == EMPTY; }
+
+    static uint64_t hash(Key key) {
+        if constexpr (K <= 31) {
+            return mix64(key);
+        } else {
+            return mix64((uint64_t)key ^ mix64((uint64_t)(key >> 64)));
+        }
+    }
+
+    // Returns false if the k bases contain anything other than ACGT
+    static bool encode(const char* bases, Key& out) {
+        Key key = 0;
+        for (int i = 0; i < K; i++) {
+            uint8_t c = baseCode(bases[i]);
+            if (c > 3) return false;
+            key = (key << 2) | c;
+        }
+        out = key;
+        return true;
+    }
+
+    static size_t keyBytes(int) { return sizeof(Key); }
+
+    // Binary form used in spill runs: the raw word
+    static void writeKey(std::ostream& out, Key key) {
+        out.write(reinterpret_cast<const char*>(&key), sizeof(Key));
+    }
+
+    static bool readKey(std::istream& in, Key& key) {
+        return (bool)in.read(reinterpret_cast<char*>(&key), sizeof(Key));
+    }
+
+    static Key fromString(const std::string& s) {
+        Key key = EMPTY;
+        if (s.size() == (size_t)K) encode(s.data(), key);
+        return key;
+    }
+
+    static std::string toString(Key key) {
+        std::string s(K, 'A');
+        formatKey(&s[0], key);
+        return s;
+    }
+
+    static size_t textSize(Key) { return K; }
+    static char* formatKey(char* out, Key key) {
+        static const char bases[] = {'A', 'C', 'G', 'T'};
+        for (int i = K - 1; i >= 0; i--) {
+            out[i] = bases[(uint8_t)(key & 3)];
+            key >>= 2;
+        }
+        return out + K;
+    }
+};
+
+#endif
@@ -0,0 +1,586 @@
+#ifndef KMER_COUNTER_H
+#define KMER_COUNTER_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <stdexcept>
+#include <algorithm>
+#include <unordered_map>
+#include "Hasher.h"
+#include "KmerEngine.h"
+#include "BucketBalancer.h"
+#include "SuperMerStats.h"
+#include "MemoryBudget.h"
+#include "Placement.h"
+#include "StageStats.h"
+#include "FastReader.h"
+
+// Counting as a library. A counter takes buffers of bases (or every bundle
+// of a ParallelReader), counts them on its workers as they arrive, and once
+// finished looks k-mers up, streams every count, or builds a histogram or
+// top list, all in memory. pipeline.cpp is a command line over it.
+//
+//   CounterConfig config;
+//   config.k = 31;
+//   config.m = 15;
+//   config.threads = 8;
+//   BasicKmerCounter<PackedKmerTraits<31>> counter(config);
+//   counter.add(reads);  // as often as needed; reads split by RECORD_SEPARATOR
+//   counter.finish();
+//   uint64_t n = counter.count("ACGTACGTACGTACGTACGTACGTACGTACG");
+//   counter.forEach([](const auto& kmer, uint64_t count) { ... });
+//
+// Link Hasher.cpp and SuperMers.cpp, and -lz.
+
+// How workers count: hash tables, sorting, or picked per partition
+enum class CountEngine { Hash, Sort, Auto };
+
+struct CounterConfig {
+    int k = 31;
+    int m = 15;
+    unsigned threads = 1;
+    MinimizerOrder order = MinimizerOrder::Lexicographic;
+    bool staticBuckets = false;   // route by minimizer hash, without sampling the input
+    size_t maxMemory = 0;         // bytes, 0 = unlimited
+    unsigned inputBuffers = 1;    // buffers held at once, to size them under maxMemory
+    bool spill = false;           // flush full tables to sorted runs on disk
+    std::string tmpDir;           // where runs go, default $TMPDIR
+    size_t bloomBytes = 0;        // Bloom filter pre-pass, 0 = off
+    double epsilon = 0;           // count-min sketch instead of tables, 0 = exact
+    double delta = 0.01;
+    size_t topSketch = 0;         // Space-Saving counters instead of tables, 0 = off
+    CountEngine engine = CountEngine::Hash;
+    bool numa = false;            // pin workers, spread over NUMA nodes
+    bool hugePages = false;       // transparent huge pages for the tables
+    bool taskPool = true;         // run on TaskPool::global() (else a thread per worker)
+    bool superMerStats = false;   // super-mer length statistics in the log
+    std::ostream* log = nullptr;  // progress messages, none if null
+};
+
+// Timings of the stages a counter drives itself; hashing is timed by the
+// hasher. `read` is for whoever fetches the input.
+struct CounterStages {
+    uint64_t startWall = wallNs();
+    uint64_t startCpu = processCpuNs();
+    StageClock read;       // waiting for input bundles
+    StageClock superMers;  // computing super-mers
+    StageClock route;      // sampling, expanding and submitting blocks
+    StageClock finish;     // draining the queues and final flushes
+    StageClock merge;      // merging tables and runs, or scanning them
+    StageClock output;
+};
+
+inline size_t countKmers(const std::vector<SuperMer>& superMers, int k) {
+    size_t n = 0;
+    for (const auto& sm : superMers) {
+        if (sm.bases.size() >= (size_t)k) n += sm.bases.size() - k + 1;
+    }
+    return n;
+}
+
+// Expand super-mers into per-worker KmerBlocks. Every super-mer goes to the
+// worker that owns its minimizer bucket; a worker's block is handed over
+// once it holds blockKmers k-mers.
+template <typename Traits>
+void routeSuperMers(const std::vector<SuperMer>& superMers,
+                    const KmerEngine<Traits>& engine,
+                    BucketBalancer& balancer,
+                    BasicHasher<Traits>& hasher,
+                    std::vector<BasicKmerBlock<typename Traits::Key>*>& pending,
+                    size_t blockKmers, int k) {
+    using Block = BasicKmerBlock<typename Traits::Key>;
+
+    for (const auto& superMer : superMers) {
+        if (superMer.bases.size() < (size_t)k) continue;
+        unsigned w = balancer.route(superMer.minimizer, superMer.bases.size() - k + 1);
+
+        if (!pending[w]) pending[w] = new Block(blockKmers + superMer.bases.size());
+        engine.expand(superMer.bases, pending[w]->kmers);
+        if (hasher.sortsByPartition()) {
+            // Mark where this partition's k-mers end (merging runs of one)
+            auto& segments = pending[w]->segments;
+            uint32_t p = balancer.partitionOf(superMer.minimizer);
+            uint32_t end = pending[w]->kmers.size();
+            if (!segments.empty() && segments.back().first == p) segments.back().second = end;
+            else segments.push_back({p, end});
+        }
+
+        if (pending[w]->kmers.size() >= blockKmers) {
+            hasher.submit(w, pending[w]);
+            pending[w] = nullptr;
+        }
+    }
+}
+
+// Hand over the partially filled blocks
+template <typename Traits>
+void flushBlocks(BasicHasher<Traits>& hasher,
+                 std::vector<BasicKmerBlock<typename Traits::Key>*>& pending) {
+    for (unsigned w = 0; w < pending.size(); w++) {
+        if (pending[w]) hasher.submit(w, pending[w]);
+        pending[w] = nullptr;
+    }
+}
+
+template <typename Traits>
+class BasicKmerCounter {
+public:
+    using Key = typename Traits::Key;
+    using Map = typename BasicHasher<Traits>::Map;
+
+private:
+    using Block = BasicKmerBlock<Key>;
+
+    static constexpr size_t HASH_TABLE_SIZE = 10'000'000;
+    static constexpr size_t MAX_PROBE_STEPS = 100;
+    static constexpr size_t BLOCK_KMERS = 4096;
+    static constexpr size_t BALANCE_SAMPLE_KMERS = 1 << 20;
+    // CountEngine::Auto sorts partitions over this many times the mean size
+    static constexpr double SORT_PARTITION_SKEW = 2.0;
+
+    CounterConfig config;
+    MemoryBudget budget;
+    CounterStages clocks;
+
+    size_t tableSize = HASH_TABLE_SIZE;
+    size_t bufferSize = 1 << 20;
+    size_t blockKmers = BLOCK_KMERS;
+    size_t partitionsPerWorker = 16;
+    size_t maxInFlight = 0;  // 0: two buffers per pool thread
+    SpillIOSizes spillIO;
+    size_t sortBufferKmers = 0;
+
+    std::unique_ptr<BasicHasher<Traits>> counts;
+    std::unique_ptr<BucketBalancer> balancer;
+    KmerEngine<Traits> engine;
+    SuperMerStats superMerStats;
+    std::vector<Block*> pending;
+
+    // Pinned workers need a fixed home, so numa keeps dedicated threads
+    bool usePool;
+    std::vector<std::thread> threads;
+
+    // The first super-mers are held back until the balancer has a sample
+    bool sampling;
+    size_t sampled = 0;
+    std::vector<SuperMer> sampleBuffer;
+    size_t sampleBytes = 0;
+
+    size_t numBuffers = 0;
+    size_t numSuperMers = 0;
+    bool finished = false;
+    bool merged = false;
+
+    // In pool mode super-mers of up to two buffers per pool thread (fewer
+    // under a memory limit) are computed as tasks while add() routes
+    // finished ones in order
+    struct InFlight {
+        std::string text;
+        size_t inputBytes;
+        std::vector<SuperMer> superMers;
+        size_t superMerBytes = 0;
+        std::atomic<bool> done{false};
+    };
+    std::deque<std::unique_ptr<InFlight>> inFlight;
+    std::mutex doneLock;
+    std::condition_variable doneCv;
+
+    template <typename... Args>
+    void say(const Args&... args) {
+        if (config.log) (*config.log << ... << args);
+    }
+
+    // CountEngine::Auto: once the sample is in, heavy partitions are
+    // sorted. Called before any block is submitted.
+    void pickEngines() {
+        if (config.engine != CountEngine::Auto) return;
+        std::vector<bool> heavy = balancer->heavyPartitions(SORT_PARTITION_SKEW);
+        size_t numHeavy = std::count(heavy.begin(), heavy.end(), true);
+        say("Engine: sorting ", numHeavy, " of ", heavy.size(), " partitions\n");
+        if (numHeavy > 0) counts->enableSortEngine(heavy, sortBufferKmers);
+    }
+
+    // Charged to MemStage::SuperMers from when they are computed until routed
+    static size_t footprint(const std::vector<SuperMer>& superMers) {
+        size_t bytes = superMers.capacity() * sizeof(SuperMer);
+        for (const auto& sm : superMers) bytes += sm.bases.capacity();
+        return bytes;
+    }
+
+    // Sampling and routing of one buffer's super-mers, in input order
+    void route(std::vector<SuperMer>& superMers, size_t superMerBytes) {
+        const int k = config.k;
+        StageClock::Scope timer(clocks.route);
+        numSuperMers += superMers.size();
+        if (config.superMerStats) superMerStats.add(superMers);
+        clocks.route.count(0, countKmers(superMers, k));
+
+        if (sampling) {
+            // Assign minimizer buckets to workers from a sample of the input
+            for (const auto& sm : superMers) {
+                if (sm.bases.size() < (size_t)k) continue;
+                balancer->sample(sm.minimizer, sm.bases.size() - k + 1);
+                sampled += sm.bases.size() - k + 1;
+            }
+            sampleBuffer.insert(sampleBuffer.end(), std::make_move_iterator(superMers.begin()),
+                                std::make_move_iterator(superMers.end()));
+            sampleBytes += superMerBytes;
+            bool sampleFull = budget.limited() && sampleBytes >= budget.limit(MemStage::SuperMers);
+            if (sampled < BALANCE_SAMPLE_KMERS && !sampleFull) return;
+
+            pickEngines();
+            balancer->rebalance();
+            sampling = false;
+            routeSuperMers(sampleBuffer, engine, *balancer, *counts, pending, blockKmers, k);
+            sampleBuffer = std::vector<SuperMer>();
+            budget.release(MemStage::SuperMers, sampleBytes);
+            return;
+        }
+
+        // Route blocks to their workers
+        routeSuperMers(superMers, engine, *balancer, *counts, pending, blockKmers, k);
+        budget.release(MemStage::SuperMers, superMerBytes);
+    }
+
+    void routeOldest() {
+        TaskPool& pool = TaskPool::global();
+        InFlight& next = *inFlight.front();
+        while (!next.done.load()) {
+            if (pool.runOne()) continue;
+            std::unique_lock<std::mutex> guard(doneLock);
+            doneCv.wait_for(guard, std::chrono::milliseconds(1), [&]() { return next.done.load(); });
+        }
+        budget.release(MemStage::Input, next.inputBytes);
+        route(next.superMers, next.superMerBytes);
+        inFlight.pop_front();
+    }
+
+    void requireFinished(const char* what) const {
+        if (!finished) throw std::logic_error(std::string("KmerCounter: ") + what + " before finish()");
+    }
+
+public:
+    // Sets up the tables and starts the workers. Throws
+    // std::invalid_argument for a configuration that can't count.
+    explicit BasicKmerCounter(const CounterConfig& cfg)
+        : config(cfg),
+          budget(cfg.maxMemory - std::min(cfg.maxMemory, cfg.bloomBytes)),
+          engine(cfg.k, cfg.m, cfg.order),
+          superMerStats(cfg.k),
+          pending(cfg.threads, nullptr),
+          usePool(cfg.taskPool && !cfg.numa),
+          sampling(!cfg.staticBuckets) {
+        const int k = config.k;
+        if (config.threads == 0) throw std::invalid_argument("KmerCounter needs at least one thread");
+        if (k <= 0 || config.m <= 0 || config.m > k) throw std::invalid_argument("KmerCounter needs 0 < m <= k");
+        if (config.maxMemory > 0 && config.bloomBytes >= config.maxMemory) {
+            throw std::invalid_argument("the Bloom filter must be smaller than the memory limit");
+        }
+
+        // Derive sizes from the memory limit, less what the Bloom filter takes
+        if (budget.limited()) {
+            MemoryPlan plan = planMemory(budget, config.threads, Traits::keyBytes(k) + sizeof(size_t), k, config.m);
+            tableSize = plan.tableSlots;
+            // Every input buffer is held while the next one fills
+            bufferSize = std::max<size_t>(plan.bundleSize / std::max(1u, config.inputBuffers), 64 << 10);
+            blockKmers = plan.blockKmers;
+            partitionsPerWorker = plan.partitionsPerWorker;
+            maxInFlight = plan.bundlesInFlight;
+            spillIO = plan.spillIO;
+            say("Memory budget ", config.maxMemory >> 20, " MB: ", tableSize, " slots per table, ",
+                bufferSize, " byte bundles (", maxInFlight, " in flight), ", blockKmers, " k-mers per block, ",
+                partitionsPerWorker, " partitions per worker, merging up to ", spillIO.fanIn, " runs with ",
+                spillIO.readerSlotBytes >> 10, " KB read-ahead slots\n");
+        }
+
+        // Hasher with one queue per worker
+        say("Initializing Hasher...\n");
+        // Sketches and sorting replace the tables, so keep those tiny. A sort
+        // buffer holds as many k-mers as a table has slots (it and its sort
+        // scratch take about the table's memory).
+        bool approximate = config.epsilon > 0;
+        sortBufferKmers = tableSize;
+        if (config.topSketch || approximate || config.engine == CountEngine::Sort) tableSize = 1009;
+        counts = std::make_unique<BasicHasher<Traits>>(config.threads, tableSize, MAX_PROBE_STEPS);
+        counts->setMemoryBudget(&budget, Traits::keyBytes(k));
+        counts->setSpillIO(spillIO);
+        if (config.spill && !config.topSketch && !approximate) counts->enableTableSpill(config.tmpDir);
+        if (config.bloomBytes > 0) {
+            counts->enableBloomFilter(config.bloomBytes);
+            say("Bloom filter: ", config.bloomBytes >> 20, " MB, counting k-mers seen twice or more\n");
+        }
+        if (config.numa || config.hugePages) {
+            std::vector<int> cpus;
+            if (config.numa) {
+                NumaTopology topo = NumaTopology::detect();
+                cpus = topo.spread(config.threads);
+                say("NUMA: ", topo.numNodes(), " node(s), workers pinned to CPUs");
+                for (int cpu : cpus) say(" ", cpu);
+                say("\n");
+            }
+            counts->setPlacement(cpus, config.hugePages);
+        }
+        if (config.engine == CountEngine::Sort) {
+            counts->enableSortEngine({}, sortBufferKmers);
+            say("Sort engine: ", sortBufferKmers, " k-mers per sort buffer\n");
+        }
+        if (approximate) {
+            counts->enableApproximate(config.epsilon, config.delta);
+            const CountMinSketch& cms = *counts->getApproximate();
+            say("Count-min sketch: ", cms.rows(), " x ", cms.columns(), " counters (",
+                cms.bytes() >> 20, " MB)\n");
+        }
+        if (config.topSketch) counts->enableTopSketch(config.topSketch);
+
+        if (usePool) {
+            say("Scheduling on a pool of ", TaskPool::global().size(), " threads...\n");
+            counts->runOn(TaskPool::global());
+        } else {
+            say("Launching ", config.threads, " worker threads...\n");
+            for (unsigned i = 0; i < config.threads; i++) {
+                threads.emplace_back(&BasicHasher<Traits>::worker, counts.get(), i);
+            }
+        }
+        balancer = std::make_unique<BucketBalancer>(config.threads, partitionsPerWorker,
+                                                    config.staticBuckets ? 0 : (1 << 22));
+    }
+
+    ~BasicKmerCounter() {
+        try {
+            finish();
+        } catch (...) {
+        }
+    }
+
+    BasicKmerCounter(const BasicKmerCounter&) = delete;
+    BasicKmerCounter& operator=(const BasicKmerCounter&) = delete;
+
+    // Input buffer size that fits the memory plan (1 MB without a limit)
+    size_t bundleSize() const { return bufferSize; }
+
+    // Counts the k-mers of a buffer of bases. Separate sequences (reads)
+    // are split by RECORD_SEPARATOR; no k-mer spans two buffers. On the
+    // task pool super-mers are computed in the background, and add()
+    // returns while at most two buffers per pool thread (or the memory
+    // plan's bundlesInFlight) are pending.
+    void add(std::string bases) {
+        if (finished) throw std::logic_error("KmerCounter: add() after finish()");
+        const int k = config.k;
+        size_t inputBytes = bases.capacity();
+        budget.charge(MemStage::Input, inputBytes);
+        clocks.read.count(bases.size(), 0);
+        numBuffers++;
+
+        if (!usePool) {
+            std::vector<SuperMer> superMers;
+            {
+                StageClock::Scope timer(clocks.superMers);
+                superMers = engine.superMers(bases);
+            }
+            clocks.superMers.count(bases.size(), countKmers(superMers, k));
+            size_t superMerBytes = footprint(superMers);
+            budget.charge(MemStage::SuperMers, superMerBytes);
+            budget.release(MemStage::Input, inputBytes);
+            route(superMers, superMerBytes);
+            return;
+        }
+
+        TaskPool& pool = TaskPool::global();
+        auto task = std::make_unique<InFlight>();
+        task->text = std::move(bases);
+        task->inputBytes = inputBytes;
+        InFlight* slot = task.get();
+        inFlight.push_back(std::move(task));
+        pool.submit([this, slot, k]() {
+            {
+                StageClock::Scope timer(clocks.superMers);
+                slot->superMers = engine.superMers(slot->text);
+            }
+            clocks.superMers.count(slot->text.size(), countKmers(slot->superMers, k));
+            slot->superMerBytes = footprint(slot->superMers);
+            budget.charge(MemStage::SuperMers, slot->superMerBytes);
+            slot->text = std::string();
+            std::lock_guard<std::mutex> guard(doneLock);
+            slot->done = true;
+            doneCv.notify_all();
+        });
+        size_t limit = maxInFlight ? maxInFlight : 2 * pool.size();
+        while (inFlight.size() > limit) routeOldest();
+        while (!inFlight.empty() && inFlight.front()->done.load()) routeOldest();
+    }
+
+    void add(const char* bases, size_t n) { add(std::string(bases, n)); }
+
+    // Every bundle of a reader, timed as the read stage. Returns the
+    // number of bundles.
+    size_t add(ParallelReader& reader) {
+        FastBundle bundle(0);
+        auto nextBundle = [&]() {
+            StageClock::Scope timer(clocks.read);
+            return reader.next(bundle);
+        };
+        size_t n = 0;
+        for (; nextBundle(); n++) add(std::string(bundle.data.begin(), bundle.data.end()));
+        return n;
+    }
+
+    // No more input: routes what is pending and waits for the workers
+    void finish() {
+        if (finished) return;
+        finished = true;
+        while (!inFlight.empty()) routeOldest();
+
+        {
+            StageClock::Scope timer(clocks.route);
+            if (sampling) {
+                pickEngines();
+                balancer->rebalance();
+                routeSuperMers(sampleBuffer, engine, *balancer, *counts, pending, blockKmers, config.k);
+                budget.release(MemStage::SuperMers, sampleBytes);
+                sampleBuffer = std::vector<SuperMer>();
+                sampling = false;
+            }
+            flushBlocks(*counts, pending);
+        }
+
+        say("Read ", numBuffers, " bundles\n");
+        say("Total super-mers: ", numSuperMers, "\n");
+        if (config.log && config.superMerStats) superMerStats.print(*config.log);
+        if (config.log) balancer->printStats(*config.log);
+
+        // Telling workers done
+        say("Signaling completion...\n");
+        StageClock::Scope timer(clocks.finish);
+        counts->signalComplete();
+        say("Waiting for threads to finish...\n");
+        if (usePool) counts->waitForWorkers();
+        for (auto& t : threads) t.join();
+    }
+
+    // Results, after finish(). In spill mode the counts only exist as a
+    // merge of the runs on disk, which can be read once: by forEach(),
+    // count() of a list, or writeText().
+
+    // Abundance histogram: h[c] = number of distinct k-mers seen c times,
+    // everything >= maxCount in h[maxCount]. Instead of the other results;
+    // with disjoint tables no merged table is built.
+    std::vector<uint64_t> histogram(size_t maxCount) {
+        requireFinished("histogram()");
+        counts->setDisjointTables(!balancer->partitionsSplit());
+        StageClock::Scope timer(clocks.merge);
+        return counts->histogram(maxCount);
+    }
+
+    // The n most frequent k-mers, best first (estimates with a top
+    // sketch). Instead of the other results.
+    std::vector<TopEntry<Key>> top(size_t n) {
+        requireFinished("top()");
+        counts->setDisjointTables(!balancer->partitionsSplit());
+        StageClock::Scope timer(clocks.merge);
+        return counts->topN(n);
+    }
+
+    // Merges the workers' tables into one (in spill mode, flushes them to
+    // runs). Done on demand by everything below.
+    void merge() {
+        requireFinished("merge()");
+        if (merged) return;
+        merged = true;
+        StageClock::Scope timer(clocks.merge);
+        counts->mergeResults();
+    }
+
+    // Count of one k-mer, 0 if absent or not a k-mer of length k; the
+    // estimate with a count-min sketch. Not in spill mode.
+    uint64_t count(const std::string& kmer) {
+        if (config.spill && !approximate()) throw std::logic_error("KmerCounter: count() of one k-mer in spill mode");
+        return count(std::vector<std::string>{kmer})[0];
+    }
+
+    // Counts of a list of k-mers, in any mode
+    std::vector<uint64_t> count(const std::vector<std::string>& kmers) {
+        requireFinished("count()");
+        const int k = config.k;
+        std::vector<Key> keys(kmers.size());
+        std::vector<bool> valid(kmers.size());
+        for (size_t i = 0; i < kmers.size(); i++) {
+            keys[i] = Traits::fromString(kmers[i]);
+            valid[i] = kmers[i].size() == (size_t)k && !Traits::isEmpty(keys[i]);
+        }
+
+        std::vector<uint64_t> result(kmers.size(), 0);
+        if (approximate() || !config.spill) {
+            if (!approximate()) merge();
+            for (size_t i = 0; i < kmers.size(); i++) {
+                if (valid[i]) result[i] = counts->lookup(keys[i]);
+            }
+            return result;
+        }
+
+        // Pick the k-mers out of the merge of the runs
+        std::unordered_map<Key, uint64_t, typename Traits::KeyHash> wanted;
+        for (size_t i = 0; i < kmers.size(); i++) {
+            if (valid[i]) wanted[keys[i]] = 0;
+        }
+        forEach([&](const Key& key, uint64_t n) {
+            auto it = wanted.find(key);
+            if (it != wanted.end()) it->second = n;
+        });
+        for (size_t i = 0; i < kmers.size(); i++) {
+            if (valid[i]) result[i] = wanted[keys[i]];
+        }
+        return result;
+    }
+
+    // Every (k-mer, count); Traits::toString gives the bases. In spill
+    // mode in ascending k-mer order.
+    void forEach(const std::function<void(const Key&, uint64_t)>& f) {
+        merge();
+        counts->streamResults(f);
+    }
+
+    // The merged table, to look up or iterate directly (empty in spill mode)
+    const Map& results() {
+        merge();
+        return counts->getResults();
+    }
+
+    // "kmer\tcount" lines, or the compressed format (CountFile.h, packed
+    // k-mers only). Return the number of distinct k-mers. Given an earlier
+    // compressed file (path itself, say), writeCompressed() adds these
+    // counts to its counts, copying the blocks no new k-mer falls into.
+    size_t writeText(const std::string& path) {
+        merge();
+        StageClock::Scope timer(clocks.output);
+        return counts->writeResults(path);
+    }
+
+    size_t writeCompressed(const std::string& path, const std::string& basePath = "") {
+        merge();
+        StageClock::Scope timer(clocks.output);
+        return counts->writeCompressed(path, basePath);
+    }
+
+    bool approximate() const { return counts->getApproximate() != nullptr; }
+    const CounterConfig& getConfig() const { return config; }
+
+    // Backend, memory accounting and timings, for reports
+    BasicHasher<Traits>& hasher() { return *counts; }
+    const BasicHasher<Traits>& hasher() const { return *counts; }
+    MemoryBudget& memory() { return budget; }
+    CounterStages& stages() { return clocks; }
+    const CounterStages& stages() const { return clocks; }
+};
+
+using KmerCounter = BasicKmerCounter<StringKmerTraits>;
+
+#endif
@@ -0,0 +1,160 @@
+#ifndef KMER_ENGINE_H
+#define KMER_ENGINE_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include "Kmer.h"
+#include "MinimizerOrder.h"
+#include "data_structs.h"
+#include "phase1.h"
+
+// Phase 1 (super-mers) and block expansion for one k-mer representation.
+// Only the specializations below exist.
+template <typename Traits>
+class KmerEngine;
+
+// Generic engine: runtime k, string k-mers (any k, any alphabet except
+// RECORD_SEPARATOR, which splits reads). Lowercase letters are counted as
+// uppercase, as in the packed engine.
+template <>
+class KmerEngine<StringKmerTraits> {
+    int k;
+    int m;
+    MinimizerOrder order;
+
+    void recordSuperMers(const std::string& seq, std::vector<SuperMer>& out) const {
+        if ((int)seq.size() < k) return;
+
+        for (auto& sm : computeSuperMers(seq, m, k, order)) {
+            std::string minimizer = computeMinimizer(sm.substr(0, k), m, k, order);
+            uint64_t rank = (m <= 31) ? minimizerRank(minimizer.data(), m, order)
+                                      : std::hash<std::string>{}(minimizer);
+            out.push_back({std::move(sm), rank});
+        }
+    }
+
+public:
+    KmerEngine(int k, int m, MinimizerOrder order = MinimizerOrder::Lexicographic)
+        : k(k), m(m), order(order) {}
+
+    std::vector<SuperMer> superMers(std::string seq) const {
+        std::vector<SuperMer> out;
+        upperCaseBases(seq);
+        if (seq.find(RECORD_SEPARATOR) == std::string::npos) {
+            recordSuperMers(seq, out);
+            return out;
+        }
+        size_t begin = 0;
+        while (begin < seq.size()) {
+            size_t end = std::min(seq.find(RECORD_SEPARATOR, begin), seq.size());
+            recordSuperMers(seq.substr(begin, end - begin), out);
+            begin = end + 1;
+        }
+        return out;
+    }
+
+    void expand(const std::string& superMer, std::vector<std::string>& out) const {
+        if (superMer.size() < (size_t)k) return;
+        for (size_t i = 0; i <= superMer.size() - k; i++) {
+            out.push_back(superMer.substr(i, k));
+        }
+    }
+};
+
+// Specialized engine: k is a compile-time constant, k-mers and m-mers are
+// packed 2 bits per base. Super-mers never span a non-ACGT base, so k-mers
+// containing N (or any other symbol) are skipped.
+template <int K>
+class KmerEngine<PackedKmerTraits<K>> {
+    using Traits = PackedKmerTraits<K>;
+    using Key = typename Traits::Key;
+
+    int m;
+    uint64_t mmerMask;
+    MinimizerOrder order;
+
+    // Super-mers of one run of valid bases seq[begin, end)
+    void runSuperMers(const std::string& seq, size_t begin, size_t end,
+                      std::vector<uint64_t>& mmers,
+                      std::vector<SuperMer>& out) const {
+        if (end - begin < (size_t)K) return;
+
+        // Rank of every m-mer of the run, rolling
+        size_t numMmers = end - begin - m + 1;
+        mmers.resize(numMmers);
+        uint64_t cur = 0;
+        for (size_t i = 0; i < (size_t)m - 1; i++) {
+            cur = (cur << 2) | baseCode(seq[begin + i]);
+        }
+        for (size_t i = 0; i < numMmers; i++) {
+            cur = ((cur << 2) | baseCode(seq[begin + i + m - 1])) & mmerMask;
+            mmers[i] = minimizerRank(cur, m, order);
+        }
+
+        // Slide a window of K - m + 1 m-mers; only rescan when the current
+        // minimum falls out of the window
+        const size_t window = K - m + 1;
+        size_t numKmers = end - begin - K + 1;
+        size_t minPos = 0;
+        for (size_t j = 1; j < window; j++) {
+            if (mmers[j] < mmers[minPos]) minPos = j;
+        }
+
+        uint64_t curMinimizer = mmers[minPos];
+        size_t superMerStart = 0;
+
+        for (size_t p = 1; p < numKmers; p++) {
+            size_t last = p + window - 1;
+            if (minPos < p) {
+                minPos = p;
+                for (size_t j = p + 1; j <= last; j++) {
+                    if (mmers[j] < mmers[minPos]) minPos = j;
+                }
+            } else if (mmers[last] < mmers[minPos]) {
+                minPos = last;
+            }
+
+            if (mmers[minPos] != curMinimizer) {
+                out.push_back({seq.substr(begin + superMerStart, p - 1 - superMerStart + K), curMinimizer});
+                superMerStart = p;
+                curMinimizer = mmers[minPos];
+            }
+        }
+        out.push_back({seq.substr(begin + superMerStart, numKmers - 1 - superMerStart + K), curMinimizer});
+    }
+
+public:
+    KmerEngine(int /*k*/, int m, MinimizerOrder order = MinimizerOrder::Lexicographic)
+        : m(m), mmerMask(m >= 32 ? ~0ULL : ((1ULL << (2 * m)) - 1)), order(order) {}
+
+    std::vector<SuperMer> superMers(const std::string& seq) const {
+        std::vector<SuperMer> out;
+        std::vector<uint64_t> mmers;
+
+        size_t runStart = 0;
+        for (size_t i = 0; i <= seq.size(); i++) {
+            if (i == seq.size() || baseCode(seq[i]) > 3) {
+                runSuperMers(seq, runStart, i, mmers, out);
+                runStart = i + 1;
+            }
+        }
+        return out;
+    }
+
+    void expand(const std::string& superMer, std::vector<Key>& out) const {
+        if (superMer.size() < (size_t)K) return;
+
+        Key key = 0;
+        for (int i = 0; i < K - 1; i++) {
+            key = (key << 2) | baseCode(superMer[i]);
+        }
+        for (size_t i = K - 1; i < superMer.size(); i++) {
+            key = ((key << 2) | baseCode(superMer[i])) & Traits::MASK;
+            out.push_back(key);
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,243 @@
+#ifndef MEMORY_BUDGET_H
+#define MEMORY_BUDGET_H
+
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <cstdint>
+#include <sys/resource.h>
+#include "data_structs.h"
+
+// Pipeline stages that hold memory
+enum class MemStage { Input, SuperMers, Queue, Tables, Overflow, SpillIO, NumStages };
+
+inline const char* memStageName(MemStage stage) {
+    switch (stage) {
+        case MemStage::Input: return "input bundles";
+        case MemStage::SuperMers: return "super-mers";
+        case MemStage::Queue: return "queued blocks";
+        case MemStage::Tables: return "hash tables";
+        case MemStage::Overflow: return "overflow";
+        case MemStage::SpillIO: return "spill I/O";
+        default: return "?";
+    }
+}
+
+// Parses "512M", "8G", "1048576" etc. Returns 0 on error.
+inline size_t parseMemorySize(const std::string& text) {
+    size_t pos = 0;
+    double value = 0;
+    try {
+        value = std::stod(text, &pos);
+    } catch (...) {
+        return 0;
+    }
+    std::string unit = text.substr(pos);
+    if (unit == "" || unit == "B") return (size_t)value;
+    if (unit == "K" || unit == "KB") return (size_t)(value * (1ULL << 10));
+    if (unit == "M" || unit == "MB") return (size_t)(value * (1ULL << 20));
+    if (unit == "G" || unit == "GB") return (size_t)(value * (1ULL << 30));
+    return 0;
+}
+
+// Per-stage memory accounting against a global limit. Each stage gets a
+// share of the budget; acquire() blocks a producer until its stage has room
+// again, so a slow consumer throttles the stages in front of it. A stage
+// that holds nothing always admits one request, so an oversized item can't
+// deadlock. Stages owned by a single thread are bounded by the sizes in
+// MemoryPlan and only charge(). A limit of 0 means unlimited.
+class MemoryBudget {
+    static constexpr int NUM = (int)MemStage::NumStages;
+
+    struct Stage {
+        size_t limit = 0;
+        size_t used = 0;
+        size_t peak = 0;
+    };
+
+    size_t total;
+    Stage stages[NUM];
+    std::mutex lock;
+    std::condition_variable cv;
+
+    Stage& at(MemStage stage) { return stages[(int)stage]; }
+
+    bool fits(const Stage& s, size_t bytes) const {
+        return s.limit == 0 || s.used == 0 || s.used + bytes <= s.limit;
+    }
+
+    void add(Stage& s, size_t bytes) {
+        s.used += bytes;
+        s.peak = std::max(s.peak, s.used);
+    }
+
+public:
+    explicit MemoryBudget(size_t totalBytes = 0) : total(totalBytes) {}
+
+    size_t totalBytes() const { return total; }
+    bool limited() const { return total > 0; }
+
+    void setLimit(MemStage stage, size_t bytes) {
+        std::lock_guard<std::mutex> guard(lock);
+        at(stage).limit = bytes;
+    }
+
+    size_t limit(MemStage stage) const { return stages[(int)stage].limit; }
+
+    size_t peak(MemStage stage) {
+        std::lock_guard<std::mutex> guard(lock);
+        return at(stage).peak;
+    }
+
+    void acquire(MemStage stage, size_t bytes) {
+        std::unique_lock<std::mutex> guard(lock);
+        Stage& s = at(stage);
+        cv.wait(guard, [&]() { return fits(s, bytes); });
+        add(s, bytes);
+    }
+
+    // Record memory the caller already holds and can't wait to free (for
+    // stages with a single owner, where waiting would deadlock)
+    void charge(MemStage stage, size_t bytes) {
+        std::lock_guard<std::mutex> guard(lock);
+        add(at(stage), bytes);
+    }
+
+    // Non-blocking variant: false if the stage is full
+    bool tryAcquire(MemStage stage, size_t bytes) {
+        std::lock_guard<std::mutex> guard(lock);
+        Stage& s = at(stage);
+        if (s.limit != 0 && s.used + bytes > s.limit) return false;
+        add(s, bytes);
+        return true;
+    }
+
+    void release(MemStage stage, size_t bytes) {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            Stage& s = at(stage);
+            s.used -= std::min(s.used, bytes);
+        }
+        cv.notify_all();
+    }
+
+    void printReport(std::ostream& out) {
+        std::lock_guard<std::mutex> guard(lock);
+        out << "Memory (peak / limit, MB):\n";
+        for (int i = 0; i < NUM; i++) {
+            out << "  " << memStageName((MemStage)i) << ": "
+                << stages[i].peak / (1 << 20) << " / ";
+            if (stages[i].limit) out << stages[i].limit / (1 << 20) << "\n";
+            else out << "-\n";
+        }
+        // Stacks, allocator slack and the like are outside the stages
+        rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        out << "  process max RSS: " << usage.ru_maxrss / 1024 << " / ";
+        if (total) out << total / (1 << 20) << "\n";
+        else out << "-\n";
+    }
+};
+
+// Charges memory held for the lifetime of an object (nothing without a
+// budget)
+class ScopedCharge {
+    MemoryBudget* budget;
+    MemStage stage;
+    size_t bytes;
+
+public:
+    ScopedCharge(MemoryBudget* b, MemStage s, size_t n) : budget(b), stage(s), bytes(n) {
+        if (budget) budget->charge(stage, bytes);
+    }
+    ~ScopedCharge() {
+        if (budget) budget->release(stage, bytes);
+    }
+    ScopedCharge(const ScopedCharge&) = delete;
+    ScopedCharge& operator=(const ScopedCharge&) = delete;
+};
+
+// Buffers of spill runs: a writer holds writerSlots of writerSlotBytes, a
+// run open in a merge two slots of readerSlotBytes, and a merge opens at
+// most fanIn runs at once (more are merged in groups first). The defaults
+// are for an unlimited budget.
+struct SpillIOSizes {
+    unsigned writerSlots = 4;
+    size_t writerSlotBytes = 1 << 20;
+    size_t readerSlotBytes = 256 << 10;
+    size_t fanIn = 256;
+
+    size_t writerBytes() const { return writerSlots * writerSlotBytes; }
+    size_t readerBytes() const { return 2 * readerSlotBytes; }
+};
+
+// Sizes derived from a --max-memory budget
+struct MemoryPlan {
+    size_t tableSlots;          // slots per worker table
+    size_t bundleSize;          // bases per input bundle
+    size_t blockKmers;          // k-mers per queued block
+    size_t partitionsPerWorker; // balancer partitions per worker
+    size_t bundlesInFlight;     // bundles turned into super-mers at once
+    SpillIOSizes spillIO;       // run writers and merge readers
+};
+
+// Bytes of super-mers per input base. A super-mer starts about every
+// (k - m + 2) / 2 bases (the minimizer density of a window of k - m + 1
+// m-mers) and holds about k + (k - m) / 2 bases in a heap string; a
+// quarter on top covers denser orders and vector growth.
+inline size_t superMerBytesPerBase(int k, int m) {
+    double perSuperMer = sizeof(SuperMer) + k + (k - m) / 2 + 16;
+    return (size_t)(1.25 * 2 * perSuperMer / (k - m + 2)) + 1;
+}
+
+// Split of the budget: tables 55%, queued blocks 10%, input bundles and
+// their super-mers 12%, overflow 8%, spill run buffers 10%, the rest is
+// headroom for bookkeeping. slotBytes is the footprint of one table slot.
+inline MemoryPlan planMemory(MemoryBudget& budget, unsigned threads, size_t slotBytes, int k, int m) {
+    size_t total = budget.totalBytes();
+    size_t tables = total / 100 * 55;
+    size_t queue = total / 100 * 10;
+    size_t input = total / 100 * 12;
+    size_t overflow = total / 100 * 8;
+    size_t spill = total / 100 * 10;
+
+    // Bundles in flight take their own size plus their super-mers; aim for
+    // two per worker, fewer (of at least 64 KB) when the share is tight
+    size_t superMerFactor = superMerBytesPerBase(k, m);
+    size_t inFlight = input / (1 + superMerFactor);
+
+    budget.setLimit(MemStage::Tables, tables);
+    budget.setLimit(MemStage::Queue, queue);
+    budget.setLimit(MemStage::Input, inFlight);
+    budget.setLimit(MemStage::SuperMers, inFlight * superMerFactor);
+    budget.setLimit(MemStage::Overflow, overflow);
+    budget.setLimit(MemStage::SpillIO, spill);
+
+    MemoryPlan plan;
+    plan.tableSlots = std::max<size_t>(1009, tables / threads / slotBytes);
+    plan.bundleSize = std::clamp<size_t>(inFlight / (2 * threads), 64 << 10, 16 << 20);
+    plan.bundlesInFlight = std::max<size_t>(1, inFlight / plan.bundleSize);
+    // Keep at least ~4 blocks per worker in flight
+    plan.blockKmers = std::clamp<size_t>(queue / threads / 4 / slotBytes, 256, 1 << 16);
+    // Smaller tables need finer partitions so rebalancing can even out
+    // how full each worker's table gets
+    size_t perThreadMB = tables / threads >> 20;
+    plan.partitionsPerWorker = perThreadMB < 64 ? 64 : perThreadMB < 1024 ? 32 : 16;
+
+    // While counting every worker and the overflow may be writing a run.
+    // A merge writes the output and one intermediate run, and the rest
+    // goes to reading runs: slots shrink as the share gets tight, so the
+    // fan-in stays near 64 before it has to drop.
+    const size_t MIN_SLOT = 16 << 10;
+    SpillIOSizes& io = plan.spillIO;
+    io.writerSlots = 2;
+    io.writerSlotBytes = std::clamp<size_t>(spill / (threads + 1) / io.writerSlots, MIN_SLOT, 1 << 20);
+    size_t reading = spill > 4 * io.writerBytes() ? spill - 2 * io.writerBytes() : spill / 2;
+    io.readerSlotBytes = std::clamp<size_t>(reading / 2 / 64, MIN_SLOT, 256 << 10);
+    io.fanIn = std::clamp<size_t>(reading / io.readerBytes(), 2, 256);
+    return plan;
+}
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef MINIMIZER_ORDER_H
+#define MINIMIZER_ORDER_H
+
+#include <string>
+#include <cstdint>
+#include "Kmer.h"
+
+// Total orders on m-mers used to pick minimizers. Plain lexicographic order
+// lets poly-A style m-mers win far too often, which makes a few super-mer
+// buckets huge; the other two spread minimizers out.
+enum class MinimizerOrder {
+    Lexicographic,  // AAAA... < AAAC... < ...
+    Random,         // order of a fixed 64-bit hash of the m-mer
+    Signature       // KMC2/Gerbil signatures: lexicographic, but m-mers
+                    // starting with AAA or ACA, or containing AA past the
+                    // first base, rank after every other m-mer
+};
+
+inline bool parseMinimizerOrder(const std::string& name, MinimizerOrder& order) {
+    if (name == "lex" || name == "lexicographic") order = MinimizerOrder::Lexicographic;
+    else if (name == "random") order = MinimizerOrder::Random;
+    else if (name == "signature") order = MinimizerOrder::Signature;
+    else return false;
+    return true;
+}
+
+inline const char* minimizerOrderName(MinimizerOrder order) {
+    switch (order) {
+        case MinimizerOrder::Random: return "random";
+        case MinimizerOrder::Signature: return "signature";
+        default: return "lexicographic";
+    }
+}
+
+// Rank of a packed m-mer (m <= 31), lower wins. Every order is injective,
+// so two m-mers have the same rank only if they are the same m-mer.
+inline uint64_t minimizerRank(uint64_t mmer, int m, MinimizerOrder order) {
+    switch (order) {
+        case MinimizerOrder::Random:
+            // mix64 is a bijection on 64-bit words
+            return mix64(mmer ^ 0x9e3779b97f4a7c15ULL);
+
+        case MinimizerOrder::Signature: {
+            uint64_t prefix3 = (m >= 3) ? (mmer >> (2 * (m - 3))) & 0x3F : 0xFF;
+            bool disallowed = (prefix3 == 0x00 /* AAA */ || prefix3 == 0x04 /* ACA */);
+            for (int i = 1; i + 1 < m && !disallowed; i++) {
+                if (((mmer >> (2 * (m - 2 - i))) & 0xF) == 0) disallowed = true;  // AA at i
+            }
+            return disallowed ? (mmer | (1ULL << 63)) : mmer;
+        }
+
+        default:
+            return mmer;
+    }
+}
+
+// Same ranking for an m-mer given as text; symbols other than ACGT are
+// treated as A. Only used for m <= 31.
+inline uint64_t minimizerRank(const char* bases, int m, MinimizerOrder order) {
+    uint64_t mmer = 0;
+    for (int i = 0; i < m; i++) {
+        mmer = (mmer << 2) | (baseCode(bases[i]) & 3);
+    }
+    return minimizerRank(mmer, m, order);
+}
+
+#endif
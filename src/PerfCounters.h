@@ -0,0 +1,128 @@
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Hardware performance counters for --perf, through perf_event_open (no
+// libpfm, no perf binary). Each thread opens its own counter group on
+// first use; timed sections read the group before and after and add the
+// difference. Only user-space events are counted, so this works with
+// perf_event_paranoid up to 2. Events the CPU or a VM doesn't expose are
+// left out and reported as unavailable.
+
+enum PerfEvent { PerfCycles, PerfInstructions, PerfLLCMisses, PerfDTLBMisses, PerfBranchMisses, NUM_PERF_EVENTS };
+
+inline const char* perfEventName(int event) {
+    static const char* names[NUM_PERF_EVENTS] = {"cycles", "instructions", "llc_misses",
+                                                 "dtlb_misses", "branch_misses"};
+    return names[event];
+}
+
+struct PerfSample {
+    uint64_t values[NUM_PERF_EVENTS] = {};
+
+    PerfSample& operator+=(const PerfSample& other) {
+        for (int e = 0; e < NUM_PERF_EVENTS; e++) values[e] += other.values[e];
+        return *this;
+    }
+    PerfSample& operator-=(const PerfSample& other) {
+        for (int e = 0; e < NUM_PERF_EVENTS; e++) values[e] -= other.values[e];
+        return *this;
+    }
+};
+
+class PerfCounters {
+    int fds[NUM_PERF_EVENTS];
+    int leader = -1;
+    int slots[NUM_PERF_EVENTS];  // position of each event in a group read, -1 if not opened
+    int numOpen = 0;
+
+    static void config(int event, perf_event_attr& attr) {
+        switch (event) {
+            case PerfCycles:
+                attr.type = PERF_TYPE_HARDWARE;
+                attr.config = PERF_COUNT_HW_CPU_CYCLES;
+                break;
+            case PerfInstructions:
+                attr.type = PERF_TYPE_HARDWARE;
+                attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+                break;
+            case PerfLLCMisses:
+                attr.type = PERF_TYPE_HARDWARE;
+                attr.config = PERF_COUNT_HW_CACHE_MISSES;
+                break;
+            case PerfDTLBMisses:
+                attr.type = PERF_TYPE_HW_CACHE;
+                attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                              (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+                break;
+            case PerfBranchMisses:
+                attr.type = PERF_TYPE_HARDWARE;
+                attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+                break;
+        }
+    }
+
+    // Counts for the calling thread on any CPU
+    PerfCounters() {
+        for (int e = 0; e < NUM_PERF_EVENTS; e++) {
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            config(e, attr);
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+                               PERF_FORMAT_TOTAL_TIME_RUNNING;
+            fds[e] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, leader, 0);
+            slots[e] = fds[e] >= 0 ? numOpen++ : -1;
+            if (fds[e] >= 0 && leader < 0) leader = fds[e];
+        }
+    }
+
+public:
+    ~PerfCounters() {
+        for (int fd : fds) {
+            if (fd >= 0) close(fd);
+        }
+    }
+
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    // Set once before any thread reads counters
+    static std::atomic<bool>& enabled() {
+        static std::atomic<bool> on{false};
+        return on;
+    }
+
+    // The calling thread's counters, opened on first use
+    static PerfCounters& thread() {
+        static thread_local PerfCounters counters;
+        return counters;
+    }
+
+    bool available(int event) const { return slots[event] >= 0; }
+
+    // Counts so far, scaled up if the kernel had to multiplex the group
+    bool read(PerfSample& sample) const {
+        if (leader < 0) return false;
+        uint64_t buffer[3 + NUM_PERF_EVENTS];
+        if (::read(leader, buffer, sizeof(buffer)) < (ssize_t)((3 + numOpen) * sizeof(uint64_t))) return false;
+        uint64_t enabledNs = buffer[1], runningNs = buffer[2];
+        for (int e = 0; e < NUM_PERF_EVENTS; e++) {
+            if (slots[e] < 0) continue;
+            uint64_t value = buffer[3 + slots[e]];
+            sample.values[e] = runningNs && runningNs < enabledNs
+                ? (uint64_t)((double)value * enabledNs / runningNs) : value;
+        }
+        return true;
+    }
+};
+
+#endif
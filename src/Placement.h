@@ -0,0 +1,148 @@
+#ifndef PLACEMENT_H
+#define PLACEMENT_H
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <new>
+#include <memory>
+#include <type_traits>
+#include <cstdlib>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+
+// Thread and memory placement for multi-socket machines, from sysfs (no
+// libnuma): which CPUs belong to which NUMA node, pinning threads to CPUs,
+// and a table allocator that can ask for transparent huge pages.
+
+// "0-3,8,10-11" -> {0, 1, 2, 3, 8, 10, 11} (sysfs CPU and node lists)
+inline std::vector<int> parseCpuList(const std::string& text) {
+    std::vector<int> cpus;
+    std::stringstream in(text);
+    for (std::string range; std::getline(in, range, ',');) {
+        if (range.empty()) continue;
+        size_t dash = range.find('-');
+        int first = std::atoi(range.c_str());
+        int last = dash == std::string::npos ? first : std::atoi(range.c_str() + dash + 1);
+        for (int c = first; c <= last; c++) cpus.push_back(c);
+    }
+    return cpus;
+}
+
+class NumaTopology {
+    std::vector<std::vector<int>> nodeCpus;  // CPUs this process may use, per node
+
+public:
+    // Reads /sys/devices/system/node; without it, one node with every CPU
+    // the process is allowed on
+    static NumaTopology detect() {
+        cpu_set_t allowed;
+        CPU_ZERO(&allowed);
+        bool haveMask = sched_getaffinity(0, sizeof(allowed), &allowed) == 0;
+        auto usable = [&](int cpu) { return !haveMask || (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed)); };
+
+        NumaTopology topo;
+        std::ifstream online("/sys/devices/system/node/online");
+        std::string nodes;
+        std::getline(online, nodes);
+        for (int node : parseCpuList(nodes)) {
+            std::ifstream in("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+            std::string list;
+            std::getline(in, list);
+            std::vector<int> cpus;
+            for (int cpu : parseCpuList(list)) {
+                if (usable(cpu)) cpus.push_back(cpu);
+            }
+            if (!cpus.empty()) topo.nodeCpus.push_back(cpus);
+        }
+        if (topo.nodeCpus.empty()) {
+            std::vector<int> cpus;
+            for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+                if (haveMask ? CPU_ISSET(cpu, &allowed) : cpu == 0) cpus.push_back(cpu);
+            }
+            topo.nodeCpus.push_back(cpus);
+        }
+        return topo;
+    }
+
+    size_t numNodes() const { return nodeCpus.size(); }
+    const std::vector<int>& cpus(size_t node) const { return nodeCpus[node]; }
+
+    // A CPU for each of n workers: nodes take turns so every socket gets
+    // its share, and CPUs within a node are used in order (wrapping around
+    // when there are more workers than CPUs)
+    std::vector<int> spread(unsigned n) const {
+        std::vector<int> placement;
+        std::vector<size_t> next(nodeCpus.size(), 0);
+        for (unsigned w = 0; w < n; w++) {
+            size_t node = w % nodeCpus.size();
+            placement.push_back(nodeCpus[node][next[node]++ % nodeCpus[node].size()]);
+        }
+        return placement;
+    }
+
+    // Node a CPU belongs to (0 if unknown)
+    size_t nodeOf(int cpu) const {
+        for (size_t node = 0; node < nodeCpus.size(); node++) {
+            for (int c : nodeCpus[node]) {
+                if (c == cpu) return node;
+            }
+        }
+        return 0;
+    }
+};
+
+inline bool pinCurrentThread(int cpu) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+
+// Allocator for hash table arrays. With hugePages set, arrays of 2 MB and
+// up are mapped directly and marked MADV_HUGEPAGE so transparent huge pages
+// back them, cutting TLB misses on random probes. Either way the pages are
+// only placed on a NUMA node when first written, so a table filled from its
+// worker thread lands on that worker's node.
+template <typename T>
+struct TableAllocator {
+    using value_type = T;
+    // A table assigned a new allocator (setHugePages) must take it along
+    using propagate_on_container_copy_assignment = std::true_type;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+    static constexpr size_t HUGE_PAGE = 2 << 20;
+
+    bool hugePages = false;
+
+    TableAllocator() = default;
+    explicit TableAllocator(bool hugePages) : hugePages(hugePages) {}
+    template <typename U>
+    TableAllocator(const TableAllocator<U>& other) : hugePages(other.hugePages) {}
+
+    bool mapped(size_t n) const { return hugePages && n * sizeof(T) >= HUGE_PAGE; }
+
+    static size_t mappedBytes(size_t n) { return (n * sizeof(T) + HUGE_PAGE - 1) / HUGE_PAGE * HUGE_PAGE; }
+
+    T* allocate(size_t n) {
+        if (!mapped(n)) return std::allocator<T>().allocate(n);
+        void* p = mmap(nullptr, mappedBytes(n), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED) throw std::bad_alloc();
+        madvise(p, mappedBytes(n), MADV_HUGEPAGE);
+        return static_cast<T*>(p);
+    }
+
+    void deallocate(T* p, size_t n) {
+        if (mapped(n)) munmap(p, mappedBytes(n));
+        else std::allocator<T>().deallocate(p, n);
+    }
+
+    template <typename U>
+    bool operator==(const TableAllocator<U>& other) const { return hugePages == other.hugePages; }
+    template <typename U>
+    bool operator!=(const TableAllocator<U>& other) const { return hugePages != other.hugePages; }
+};
+
+#endif
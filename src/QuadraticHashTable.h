@@ -7,74 +7,133 @@
 #include <unordered_map>
 #include <functional>
 #include <iostream>
+#include <algorithm>
+#include "Kmer.h"
+#include "Placement.h"
+
+template <typename Traits>
+class BasicQuadraticHashTable {
+    public:
+        using Key = typename Traits::Key;
+        using Map = std::unordered_map<Key, size_t, typename Traits::KeyHash>;
 
-class QuadraticHashTable {
     private:
-        std::vector<std::string> keys;
-        std::vector<size_t> values;
+        std::vector<Key, TableAllocator<Key>> keys;
+        std::vector<size_t, TableAllocator<size_t>> values;
         size_t tableSize;
         size_t numElements;
         size_t maxSteps;
+        // probes[i]: inserts that took i collisions; probes[maxSteps + 1]:
+        // inserts that failed. Kept across clear().
+        std::vector<uint64_t> probes;
 
     public:
-        QuadraticHashTable(size_t size = 1009, size_t maxSteps = 5) 
-            : tableSize(size), numElements(0), maxSteps(maxSteps) {
-                keys.resize(size);
-                values.resize(size);
-
-                for (size_t i = 0; i < tableSize; i++) {
-                    keys[i] = "";
-                    values[i] = 0;
-                }
+        // With allocateNow false the slots are only allocated (and first
+        // touched) by allocate(), so a worker can place its own table on
+        // its NUMA node. Until then the table reads as empty.
+        BasicQuadraticHashTable(size_t size = 1009, size_t maxSteps = 5,
+                                bool allocateNow = true, bool hugePages = false)
+            : keys(TableAllocator<Key>(hugePages)), values(TableAllocator<size_t>(hugePages)),
+              tableSize(size), numElements(0), maxSteps(maxSteps), probes(maxSteps + 2, 0) {
+                if (allocateNow) allocate();
         }
 
-        bool insert(const std::string& kmer) {
+        // Back the slots with transparent huge pages; before allocate()
+        void setHugePages(bool huge) {
+            if (!keys.empty()) return;
+            keys = decltype(keys)(TableAllocator<Key>(huge));
+            values = decltype(values)(TableAllocator<size_t>(huge));
+        }
+
+        void allocate() {
+            if (!keys.empty()) return;
+            keys.assign(tableSize, Traits::emptyKey());
+            values.assign(tableSize, 0);
+        }
+
+        bool insert(const Key& kmer) {
             size_t i = 0;
             size_t hashPos;
-            
+            uint64_t baseHash = Traits::hash(kmer);
+
             while (true) {
-                hashPos = computeHash(kmer, i) % tableSize;
+                hashPos = (baseHash + 5696063 * i * i) % tableSize;
 
-                if (keys[hashPos] == "") {
+                if (Traits::isEmpty(keys[hashPos])) {
                     keys[hashPos] = kmer;
                     values[hashPos] = 1;
                     numElements++;
+                    probes[i]++;
                     return true;
                 }
-                
+
                 if (keys[hashPos] == kmer) {
                     values[hashPos]++;
+                    probes[i]++;
                     return true;
                 }
-                
+
                 // collision
                 ++i;
                 if (i > maxSteps) {
+                    probes[i]++;
                     return false;
                 }
             }
         }
 
-        uint64_t computeHash(const std::string& str, size_t i) const {
-            std::hash<std::string> hasher;
-            uint64_t baseHash = hasher(str);
-            
+        size_t capacity() const { return tableSize; }
+        size_t size() const { return numElements; }
+        const std::vector<uint64_t>& probeHistogram() const { return probes; }
+        uint64_t failedInserts() const { return probes.back(); }
+
+        uint64_t computeHash(const Key& kmer, size_t i) const {
+            uint64_t baseHash = Traits::hash(kmer);
+
             return baseHash + 5696063 * i * i;
         }
 
-        void exportToMap(std::unordered_map<std::string, size_t>& map) const {
-            for (size_t i = 0; i < tableSize; i++) {
-                if (keys[i] != "") {
+        // Calls f(key, count) for every entry, in slot order
+        template <typename F>
+        void forEach(F f) const {
+            for (size_t i = 0; i < keys.size(); i++) {
+                if (!Traits::isEmpty(keys[i])) f(keys[i], values[i]);
+            }
+        }
+
+        // Calls f(key, count) for every entry in ascending key order. Sorts
+        // a 4-byte index per entry rather than copying the entries.
+        template <typename F>
+        void forEachSorted(F f) const {
+            std::vector<uint32_t> order;
+            order.reserve(numElements);
+            for (size_t i = 0; i < keys.size(); i++) {
+                if (!Traits::isEmpty(keys[i])) order.push_back((uint32_t)i);
+            }
+            std::sort(order.begin(), order.end(),
+                      [this](uint32_t a, uint32_t b) { return keys[a] < keys[b]; });
+            for (uint32_t i : order) f(keys[i], values[i]);
+        }
+
+        void clear() {
+            std::fill(keys.begin(), keys.end(), Traits::emptyKey());
+            std::fill(values.begin(), values.end(), 0);
+            numElements = 0;
+        }
+
+        void exportToMap(Map& map) const {
+            for (size_t i = 0; i < keys.size(); i++) {
+                if (!Traits::isEmpty(keys[i])) {
                     map[keys[i]] += values[i];
                 }
             }
         }
-        
+
         void printStats() const {
             size_t occupied = 0;
             size_t totalCount = 0;
-            for (size_t i = 0; i < tableSize; i++) {
-                if (keys[i] != "") {
+            for (size_t i = 0; i < keys.size(); i++) {
+                if (!Traits::isEmpty(keys[i])) {
                     occupied++;
                     totalCount += values[i];
                 }
@@ -84,4 +143,6 @@ class QuadraticHashTable {
         }
 };
 
-#endif
\ No newline at end of file
+using QuadraticHashTable = BasicQuadraticHashTable<StringKmerTraits>;
+
+#endif
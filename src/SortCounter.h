@@ -0,0 +1,85 @@
+#ifndef SORT_COUNTER_H
+#define SORT_COUNTER_H
+
+#include <vector>
+#include <algorithm>
+#include <utility>
+#include <cstdint>
+
+// Sort-based counting (as in KMC): k-mers are appended to a flat array,
+// sorted, and counted as runs of equal keys. Every pass streams through
+// memory instead of probing a table at random. Packed k-mers use an LSD
+// radix sort over their 2k bits; string k-mers fall back to std::sort.
+
+// LSD radix sort, 8 bits per pass over the low `bits` bits. A pass whose
+// digit is the same in every key is skipped.
+template <typename Key>
+void radixSort(std::vector<Key>& keys, std::vector<Key>& scratch, int bits) {
+    size_t n = keys.size();
+    if (n < 256) {
+        std::sort(keys.begin(), keys.end());
+        return;
+    }
+    scratch.resize(n);
+    for (int shift = 0; shift < bits; shift += 8) {
+        size_t counts[256] = {};
+        for (const Key& key : keys) counts[(uint8_t)(key >> shift)]++;
+        if (counts[(uint8_t)(keys[0] >> shift)] == n) continue;
+
+        size_t offsets[256];
+        size_t sum = 0;
+        for (int d = 0; d < 256; d++) {
+            offsets[d] = sum;
+            sum += counts[d];
+        }
+        for (const Key& key : keys) scratch[offsets[(uint8_t)(key >> shift)]++] = key;
+        keys.swap(scratch);
+    }
+}
+
+template <typename Traits>
+void sortKeys(std::vector<typename Traits::Key>& keys, std::vector<typename Traits::Key>& scratch) {
+    if constexpr (Traits::packed) {
+        radixSort(keys, scratch, Traits::BITS);
+    } else {
+        std::sort(keys.begin(), keys.end());
+    }
+}
+
+// Run-length count of sorted keys, appended to out
+template <typename Key>
+void countRuns(const std::vector<Key>& sorted, std::vector<std::pair<Key, uint64_t>>& out) {
+    for (size_t i = 0; i < sorted.size();) {
+        size_t j = i + 1;
+        while (j < sorted.size() && sorted[j] == sorted[i]) j++;
+        out.push_back({sorted[i], j - i});
+        i = j;
+    }
+}
+
+// Merges two sorted count lists into `into`, summing equal keys
+template <typename Key>
+void mergeCounts(std::vector<std::pair<Key, uint64_t>>& into,
+                 const std::vector<std::pair<Key, uint64_t>>& more) {
+    if (into.empty()) {
+        into = more;
+        return;
+    }
+    std::vector<std::pair<Key, uint64_t>> merged;
+    merged.reserve(into.size() + more.size());
+    size_t a = 0, b = 0;
+    while (a < into.size() || b < more.size()) {
+        if (b == more.size() || (a < into.size() && into[a].first < more[b].first)) {
+            merged.push_back(into[a++]);
+        } else if (a == into.size() || more[b].first < into[a].first) {
+            merged.push_back(more[b++]);
+        } else {
+            merged.push_back({into[a].first, into[a].second + more[b].second});
+            a++;
+            b++;
+        }
+    }
+    into.swap(merged);
+}
+
+#endif
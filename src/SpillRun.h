@@ -0,0 +1,149 @@
+#ifndef SPILL_RUN_H
+#define SPILL_RUN_H
+
+#include <string>
+#include <vector>
+#include <queue>
+#include <algorithm>
+#include <memory>
+#include <stdexcept>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <unistd.h>
+#include "AsyncIO.h"
+#include "MemoryBudget.h"
+
+// Temporary files go to $TMPDIR (default /tmp) unless a directory is given
+inline std::string defaultTempDir() {
+    const char* dir = std::getenv("TMPDIR");
+    return dir ? dir : "/tmp";
+}
+
+// Creates a new empty file <dir>/<prefix>XXXXXX and returns its path
+inline std::string makeTempPath(const std::string& dir, const std::string& prefix) {
+    std::string pattern = (dir.empty() ? defaultTempDir() : dir) + "/" + prefix + "XXXXXX";
+    int fd = mkstemp(&pattern[0]);
+    if (fd < 0) throw std::runtime_error("Could not create temporary file " + pattern);
+    close(fd);
+    return pattern;
+}
+
+// A run is a file of (k-mer, count) records in ascending k-mer order. Keys
+// are written with Traits::writeKey (raw packed words, or length-prefixed
+// strings for the generic engine) followed by a 64-bit count. The write
+// buffers are charged to the spill I/O share of a budget if given.
+template <typename Traits>
+class RunWriter {
+    ScopedCharge charge;
+    AsyncOFStream out;
+    std::string path;
+    size_t records = 0;
+
+public:
+    explicit RunWriter(const std::string& p, const SpillIOSizes& io = SpillIOSizes(), MemoryBudget* budget = nullptr)
+        : charge(budget, MemStage::SpillIO, io.writerBytes()), out(p, io.writerSlots, io.writerSlotBytes),
+          path(p) {}
+
+    void write(const typename Traits::Key& key, uint64_t count) {
+        Traits::writeKey(out, key);
+        out.write(reinterpret_cast<const char*>(&count), sizeof(count));
+        records++;
+    }
+
+    void close() {
+        out.close();
+        if (!out) throw std::runtime_error("Could not write run file: " + path);
+    }
+
+    size_t size() const { return records; }
+};
+
+// Many runs are open at once during a merge, so each gets two slots of
+// read-ahead, charged to the spill I/O share of a budget if given
+template <typename Traits>
+class RunReader {
+    ScopedCharge charge;
+    AsyncIFStream in;
+
+public:
+    typename Traits::Key key;
+    uint64_t count = 0;
+
+    RunReader(const std::string& path, size_t slotBytes, MemoryBudget* budget = nullptr)
+        : charge(budget, MemStage::SpillIO, 2 * slotBytes), in(path, 2, slotBytes) {}
+
+    // Advances to the next record; false at end of run
+    bool next() {
+        if (!Traits::readKey(in, key)) return false;
+        return (bool)in.read(reinterpret_cast<char*>(&count), sizeof(count));
+    }
+};
+
+// Multi-way streaming merge of sorted runs. Equal k-mers from different
+// runs are summed, so the output has one record per distinct k-mer in
+// ascending order. More runs than maxFanIn are first merged in groups
+// into intermediate runs. Input runs are deleted once merged. Read-ahead
+// and fan-in come from SpillIOSizes.
+template <typename Traits>
+class RunMerger {
+    using Key = typename Traits::Key;
+
+    std::vector<std::string> paths;
+    std::string tmpDir;
+    SpillIOSizes io;
+    MemoryBudget* budget;
+    size_t maxFanIn;
+
+    template <typename F>
+    void mergeGroup(const std::vector<std::string>& group, F emit) {
+        std::vector<std::unique_ptr<RunReader<Traits>>> readers;
+        using Head = std::pair<Key, size_t>;  // current key, reader index
+        std::priority_queue<Head, std::vector<Head>, std::greater<Head>> heap;
+
+        for (const auto& path : group) {
+            readers.push_back(std::make_unique<RunReader<Traits>>(path, io.readerSlotBytes, budget));
+            if (readers.back()->next()) heap.push({readers.back()->key, readers.size() - 1});
+        }
+
+        while (!heap.empty()) {
+            Key key = heap.top().first;
+            uint64_t total = 0;
+            while (!heap.empty() && heap.top().first == key) {
+                size_t r = heap.top().second;
+                heap.pop();
+                total += readers[r]->count;
+                if (readers[r]->next()) heap.push({readers[r]->key, r});
+            }
+            emit(key, total);
+        }
+
+        readers.clear();
+        for (const auto& path : group) std::remove(path.c_str());
+    }
+
+public:
+    RunMerger(std::vector<std::string> runs, std::string dir = "", const SpillIOSizes& sizes = SpillIOSizes(),
+              MemoryBudget* b = nullptr)
+        : paths(std::move(runs)), tmpDir(std::move(dir)), io(sizes), budget(b),
+          maxFanIn(std::max<size_t>(sizes.fanIn, 2)) {}
+
+    // Calls emit(key, count) for every distinct k-mer in ascending order
+    template <typename F>
+    void merge(F emit) {
+        while (paths.size() > maxFanIn) {
+            std::vector<std::string> group(paths.begin(), paths.begin() + maxFanIn);
+            paths.erase(paths.begin(), paths.begin() + maxFanIn);
+
+            std::string merged = makeTempPath(tmpDir, "kmer_run_");
+            RunWriter<Traits> writer(merged, io, budget);
+            mergeGroup(group, [&](const Key& key, uint64_t count) { writer.write(key, count); });
+            writer.close();
+            paths.push_back(merged);
+        }
+        mergeGroup(paths, emit);
+        paths.clear();
+    }
+};
+
+#endif
@@ -0,0 +1,212 @@
+#ifndef STAGE_STATS_H
+#define STAGE_STATS_H
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <iomanip>
+#include <cstdint>
+#include <ctime>
+#include <algorithm>
+#include "PerfCounters.h"
+
+// Timing for --stats. Timed sections are coarse (a bundle, a block, a whole
+// merge), so reading the clocks costs nothing measurable.
+
+inline uint64_t wallNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+inline uint64_t cpuNs(clockid_t clock) {
+    timespec ts;
+    clock_gettime(clock, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+inline uint64_t threadCpuNs() { return cpuNs(CLOCK_THREAD_CPUTIME_ID); }
+inline uint64_t processCpuNs() { return cpuNs(CLOCK_PROCESS_CPUTIME_ID); }
+
+// Totals of one pipeline stage, which may run on several threads at once.
+// `busy` sums the wall time of every timed section and `cpu` their thread
+// CPU time; `elapsed` spans the first start to the last end. With --perf
+// the sections also add up the thread's hardware counters.
+class StageClock {
+    std::atomic<uint64_t> busy{0}, cpu{0}, bytes{0}, kmers{0};
+    std::atomic<uint64_t> first{UINT64_MAX}, last{0};
+    std::atomic<uint64_t> perf[NUM_PERF_EVENTS] = {};
+
+public:
+    class Scope {
+        StageClock& stage;
+        uint64_t wall0, cpu0;
+        PerfSample perf0;
+        bool profiling;
+    public:
+        explicit Scope(StageClock& stage)
+            : stage(stage), wall0(wallNs()), cpu0(threadCpuNs()),
+              profiling(PerfCounters::enabled() && PerfCounters::thread().read(perf0)) {}
+        ~Scope() {
+            PerfSample perf;
+            if (profiling && PerfCounters::thread().read(perf)) stage.addPerf(perf -= perf0);
+            stage.add(wall0, wallNs(), threadCpuNs() - cpu0);
+        }
+    };
+
+    void add(uint64_t start, uint64_t end, uint64_t cpuTime) {
+        busy += end - start;
+        cpu += cpuTime;
+        uint64_t f = first.load();
+        while (start < f && !first.compare_exchange_weak(f, start)) {}
+        uint64_t l = last.load();
+        while (end > l && !last.compare_exchange_weak(l, end)) {}
+    }
+
+    void addPerf(const PerfSample& sample) {
+        for (int e = 0; e < NUM_PERF_EVENTS; e++) perf[e] += sample.values[e];
+    }
+
+    PerfSample perfTotals() const {
+        PerfSample sample;
+        for (int e = 0; e < NUM_PERF_EVENTS; e++) sample.values[e] = perf[e];
+        return sample;
+    }
+
+    void count(uint64_t numBytes, uint64_t numKmers) {
+        bytes += numBytes;
+        kmers += numKmers;
+    }
+
+    double elapsedSeconds() const { return last > first ? (last - first) / 1e9 : 0; }
+    double busySeconds() const { return busy / 1e9; }
+    double cpuSeconds() const { return cpu / 1e9; }
+    uint64_t numBytes() const { return bytes; }
+    uint64_t numKmers() const { return kmers; }
+};
+
+// One line of --perf summary for a stage that processed k-mers
+inline void printPerf(std::ostream& out, const std::string& name, const StageClock& s) {
+    const PerfCounters& counters = PerfCounters::thread();
+    PerfSample sample = s.perfTotals();
+    double kmers = std::max<uint64_t>(1, s.numKmers());
+    out << "  " << name << ":";
+    if (counters.available(PerfCycles) && counters.available(PerfInstructions) && sample.values[PerfCycles]) {
+        out << " IPC " << std::setprecision(3) << (double)sample.values[PerfInstructions] / sample.values[PerfCycles];
+    }
+    for (int e = 0; e < NUM_PERF_EVENTS; e++) {
+        if (counters.available(e) && e != PerfInstructions) {
+            out << ", " << perfEventName(e) << "/k-mer " << std::setprecision(3) << sample.values[e] / kmers;
+        }
+    }
+    out << "\n";
+}
+
+// Just enough of a JSON writer for the stats and benchmark reports:
+// nested objects and arrays, written as they come, two-space indented
+class JsonWriter {
+    std::ostream& out;
+    std::vector<bool> needComma{false};
+
+    void key(const std::string& name) {
+        if (needComma.back()) out << ",";
+        needComma.back() = true;
+        out << "\n" << std::string(2 * needComma.size(), ' ');
+        if (!name.empty()) out << "\"" << name << "\": ";
+    }
+
+public:
+    explicit JsonWriter(std::ostream& out) : out(out) {
+        out << std::setprecision(6) << std::boolalpha << "{";
+    }
+
+    void beginObject(const std::string& name = "") {
+        key(name);
+        out << "{";
+        needComma.push_back(false);
+    }
+
+    void endObject() {
+        needComma.pop_back();
+        out << "\n" << std::string(2 * needComma.size(), ' ') << "}";
+    }
+
+    void beginArray(const std::string& name = "") {
+        key(name);
+        out << "[";
+        needComma.push_back(false);
+    }
+
+    void endArray() {
+        needComma.pop_back();
+        out << "\n" << std::string(2 * needComma.size(), ' ') << "]";
+    }
+
+    void field(const std::string& name, const std::string& value) {
+        key(name);
+        out << "\"" << value << "\"";
+    }
+
+    void field(const std::string& name, const char* value) { field(name, std::string(value)); }
+
+    template <typename T>
+    void field(const std::string& name, T value) {
+        key(name);
+        out << value;
+    }
+
+    template <typename T>
+    void array(const std::string& name, const std::vector<T>& values) {
+        key(name);
+        out << "[";
+        for (size_t i = 0; i < values.size(); i++) out << (i ? ", " : "") << values[i];
+        out << "]";
+    }
+
+    // Counters of the events this machine has, IPC, and with a k-mer
+    // count, each event per k-mer
+    void perf(const std::string& name, const PerfSample& sample, uint64_t kmers) {
+        const PerfCounters& counters = PerfCounters::thread();
+        beginObject(name);
+        for (int e = 0; e < NUM_PERF_EVENTS; e++) {
+            if (counters.available(e)) field(perfEventName(e), sample.values[e]);
+        }
+        if (counters.available(PerfCycles) && counters.available(PerfInstructions) && sample.values[PerfCycles]) {
+            field("ipc", (double)sample.values[PerfInstructions] / sample.values[PerfCycles]);
+        }
+        for (int e = 0; e < NUM_PERF_EVENTS && kmers; e++) {
+            if (counters.available(e)) field(std::string(perfEventName(e)) + "_per_kmer", (double)sample.values[e] / kmers);
+        }
+        endObject();
+    }
+
+    void array(const std::string& name, const std::vector<std::string>& values) {
+        key(name);
+        out << "[";
+        for (size_t i = 0; i < values.size(); i++) out << (i ? ", " : "") << "\"" << values[i] << "\"";
+        out << "]";
+    }
+
+    void stage(const std::string& name, const StageClock& s) {
+        beginObject(name);
+        double elapsed = s.elapsedSeconds();
+        field("elapsed_s", elapsed);
+        field("busy_s", s.busySeconds());
+        field("cpu_s", s.cpuSeconds());
+        if (s.numBytes()) {
+            field("bytes", s.numBytes());
+            field("bytes_per_s", elapsed > 0 ? s.numBytes() / elapsed : 0);
+        }
+        if (s.numKmers()) {
+            field("kmers", s.numKmers());
+            field("kmers_per_s", elapsed > 0 ? s.numKmers() / elapsed : 0);
+        }
+        if (PerfCounters::enabled()) perf("perf", s.perfTotals(), s.numKmers());
+        endObject();
+    }
+
+    // Closes the top-level object
+    void close() { out << "\n}\n"; }
+};
+
+#endif
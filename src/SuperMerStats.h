@@ -0,0 +1,72 @@
+#ifndef SUPERMER_STATS_H
+#define SUPERMER_STATS_H
+
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <iostream>
+#include <cstdint>
+#include "data_structs.h"
+
+// Super-mer length and minimizer bucket size distribution, used to compare
+// minimizer orders on a dataset. Sizes are counted in k-mers.
+class SuperMerStats {
+    int k;
+    size_t numSuperMers = 0;
+    size_t numKmers = 0;
+    std::vector<size_t> lengthHist;                 // k-mers per super-mer -> count
+    std::unordered_map<uint64_t, size_t> buckets;   // minimizer -> k-mers
+
+    static size_t percentile(const std::vector<size_t>& sorted, double p) {
+        if (sorted.empty()) return 0;
+        return sorted[std::min(sorted.size() - 1, (size_t)(p * sorted.size()))];
+    }
+
+public:
+    explicit SuperMerStats(int k) : k(k) {}
+
+    void add(const std::vector<SuperMer>& superMers) {
+        for (const auto& sm : superMers) {
+            if (sm.bases.size() < (size_t)k) continue;
+            size_t n = sm.bases.size() - k + 1;
+            if (n >= lengthHist.size()) lengthHist.resize(n + 1, 0);
+            lengthHist[n]++;
+            buckets[sm.minimizer] += n;
+            numSuperMers++;
+            numKmers += n;
+        }
+    }
+
+    void print(std::ostream& out) const {
+        out << "Super-mer stats:\n";
+        if (numSuperMers == 0) {
+            out << "  (no super-mers)\n";
+            return;
+        }
+
+        size_t maxLen = lengthHist.size() - 1;
+        size_t seen = 0, medianLen = 0;
+        for (size_t n = 0; n < lengthHist.size(); n++) {
+            seen += lengthHist[n];
+            if (seen * 2 >= numSuperMers) { medianLen = n; break; }
+        }
+        out << "  Super-mers: " << numSuperMers << " (" << numKmers << " k-mers)\n";
+        out << "  Length in k-mers: mean " << (double)numKmers / numSuperMers
+            << ", median " << medianLen << ", max " << maxLen << "\n";
+
+        std::vector<size_t> sizes;
+        sizes.reserve(buckets.size());
+        for (const auto& [minimizer, n] : buckets) sizes.push_back(n);
+        std::sort(sizes.begin(), sizes.end());
+
+        double mean = (double)numKmers / sizes.size();
+        out << "  Buckets (distinct minimizers): " << sizes.size() << "\n";
+        out << "  Bucket size in k-mers: mean " << mean
+            << ", p50 " << percentile(sizes, 0.50)
+            << ", p99 " << percentile(sizes, 0.99)
+            << ", max " << sizes.back()
+            << " (max/mean " << sizes.back() / mean << ")\n";
+    }
+};
+
+#endif
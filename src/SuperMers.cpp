@@ -0,0 +1,103 @@
+// The string-based super-mer functions declared in phase1.h. The generic
+// engine (KmerEngine<StringKmerTraits>) builds on them, so anything that
+// counts with it links this file.
+
+#include <string>
+#include <vector>
+#include "phase1.h"
+#include "MinimizerOrder.h"
+
+std::vector<std::string> generateKmers(const std::string &seq, int k) {
+    std::vector<std::string> kmers;
+    if ((int)seq.size() < k) return kmers;  // too short
+
+    for (size_t i = 0; i <= seq.size() - k; i++) {
+        kmers.push_back(seq.substr(i, k));
+    }
+    return kmers;
+}
+
+std::string computeMinimizer(const std::string &seq, int m, int k) {
+    return computeMinimizer(seq, m, k, MinimizerOrder::Lexicographic);
+}
+
+std::string computeMinimizer(const std::string &seq, int m, int k, MinimizerOrder order) {
+    if (order == MinimizerOrder::Lexicographic) {
+        std::string minimizer = seq.substr(0, m);
+        for (size_t i = 1; i < seq.size() - m + 1; i++) {
+            std::string current_mmer = seq.substr(i, m);
+            if (current_mmer < minimizer) {
+                minimizer = current_mmer;
+            }
+        }
+        return minimizer;
+    }
+
+    size_t best = 0;
+    uint64_t bestRank = minimizerRank(seq.data(), m, order);
+    for (size_t i = 1; i < seq.size() - m + 1; i++) {
+        uint64_t rank = minimizerRank(seq.data() + i, m, order);
+        if (rank < bestRank) {
+            bestRank = rank;
+            best = i;
+        }
+    }
+    return seq.substr(best, m);
+}
+
+std::vector<std::string> computeAllMinimizers(const std::string &seq, int m, int k) {
+    return computeAllMinimizers(seq, m, k, MinimizerOrder::Lexicographic);
+}
+
+std::vector<std::string> computeAllMinimizers(const std::string &seq, int m, int k, MinimizerOrder order) {
+    auto kmers = generateKmers(seq, k);
+    std::vector<std::string> minimizers(kmers.size());
+
+    for (size_t i = 0; i < kmers.size(); i++) {
+        minimizers[i] = computeMinimizer(kmers[i], m, k, order);
+    }
+
+    return minimizers;
+}
+
+std::vector<std::string> computeSuperMers(const std::string &seq, int m, int k) {
+    return computeSuperMers(seq, m, k, MinimizerOrder::Lexicographic);
+}
+
+std::vector<std::string> computeSuperMers(const std::string &seq, int m, int k, MinimizerOrder order) {
+    auto kmers = generateKmers(seq, k);
+    auto minimizers = computeAllMinimizers(seq, m, k, order);
+
+    std::vector<std::string> superMers;
+    std::string curSuperMer = "";
+    std::string curMinimizer = "";
+
+    for(size_t i = 0; i < kmers.size(); i++) {
+        if(i == 0) {
+            curSuperMer = kmers[i];
+            curMinimizer = minimizers[i];
+            continue;
+        }
+        if (minimizers[i] == curMinimizer) {
+            curSuperMer += kmers[i].back();
+        } else {
+            superMers.push_back(curSuperMer);
+            curSuperMer = kmers[i];
+            curMinimizer = minimizers[i];
+        }
+    }
+    superMers.push_back(curSuperMer);
+    return superMers;
+}
+
+std::vector<std::string> superMerToKmers(const std::string& superMer, int k) {
+    std::vector<std::string> kmers;
+
+    if (superMer.size() < (size_t)k) return kmers;
+
+    kmers.reserve(superMer.size() - k + 1);
+    for (size_t i = 0; i <= superMer.size() - k; i++) {
+        kmers.push_back(superMer.substr(i, k));
+    }
+    return kmers;
+}
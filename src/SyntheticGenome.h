@@ -0,0 +1,234 @@
+#ifndef SYNTHETIC_GENOME_H
+#define SYNTHETIC_GENOME_H
+
+#include <string>
+#include <vector>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include <ostream>
+#include "ThreadPool.h"
+
+// Synthetic data that behaves like sequencing data: a reference with
+// interspersed repeat families and microsatellites, and reads sampled from
+// both strands of it at a given coverage with substitution errors. Uniform
+// random sequence has almost no repeated k-mers; this has the skewed
+// k-mer spectrum (peak at the coverage, heavy repeat k-mers, error
+// singletons) that real genomes give a counter.
+//
+// Everything is generated in fixed-size chunks with their own seeds, so
+// the output depends only on the options, not on the number of threads.
+
+struct GenomeOptions {
+    size_t length = 10'000'000;
+    double gcContent = 0.41;
+    double repeatFraction = 0.15;     // share of the genome covered by repeat copies
+    size_t repeatLength = 2000;       // length of a repeat family's consensus
+    size_t repeatFamilies = 50;
+    double repeatDivergence = 0.02;   // per-base substitution rate of each copy
+    double tandemFraction = 0.02;     // share covered by microsatellites (1-6 base units)
+    uint64_t seed = 1;
+};
+
+struct ReadOptions {
+    size_t readLength = 150;
+    double coverage = 10;
+    double errorRate = 0.001;  // per-base substitutions
+    bool fastq = false;
+    uint64_t seed = 2;
+};
+
+// Fast, seedable, and good enough for test data
+struct SplitMix64 {
+    uint64_t state;
+    explicit SplitMix64(uint64_t seed) : state(seed) {}
+
+    uint64_t next() {
+        uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return z ^ (z >> 31);
+    }
+    double uniform() { return (next() >> 11) * (1.0 / (1ULL << 53)); }
+    uint64_t below(uint64_t n) { return n ? next() % n : 0; }
+
+    // Distance to the next event of a per-position rate (geometric), so
+    // sparse mutations cost one draw each instead of one per base
+    size_t skip(double rate) {
+        if (rate <= 0) return SIZE_MAX;
+        if (rate >= 1) return 0;
+        return (size_t)(std::log(1 - uniform()) / std::log(1 - rate));
+    }
+};
+
+inline char complementBase(char c) {
+    switch (c) {
+        case 'A': return 'T';
+        case 'C': return 'G';
+        case 'G': return 'C';
+        case 'T': return 'A';
+        default: return c;
+    }
+}
+
+inline void reverseComplement(std::string& seq) {
+    std::reverse(seq.begin(), seq.end());
+    for (char& c : seq) c = complementBase(c);
+}
+
+// Any base but `c`
+inline char substituteBase(char c, SplitMix64& rng) {
+    static const char BASES[] = "ACGT";
+    char b;
+    do b = BASES[rng.next() & 3]; while (b == c);
+    return b;
+}
+
+// Random bases with the given GC content, four per 64-bit draw
+inline void randomBases(char* out, size_t n, double gc, SplitMix64& rng) {
+    uint32_t threshold = (uint32_t)(gc * (1 << 15));
+    for (size_t i = 0; i < n;) {
+        uint64_t bits = rng.next();
+        for (int j = 0; j < 4 && i < n; j++, i++, bits >>= 16) {
+            bool strong = (bits & 0x7fff) < threshold;
+            bool second = bits & 0x8000;
+            out[i] = strong ? (second ? 'G' : 'C') : (second ? 'T' : 'A');
+        }
+    }
+}
+
+inline void mutate(char* seq, size_t n, double rate, SplitMix64& rng) {
+    for (size_t i = rng.skip(rate); i < n; i += 1 + rng.skip(rate)) seq[i] = substituteBase(seq[i], rng);
+}
+
+inline std::string buildGenome(const GenomeOptions& opts, TaskPool& pool = TaskPool::global()) {
+    const size_t CHUNK = 1 << 20;
+    std::string genome(opts.length, 'A');
+
+    // Background, in parallel
+    size_t numChunks = (opts.length + CHUNK - 1) / CHUNK;
+    pool.parallelFor(numChunks, [&](size_t c) {
+        SplitMix64 rng(opts.seed * 0x100000001b3ULL + c);
+        size_t begin = c * CHUNK;
+        randomBases(&genome[begin], std::min(CHUNK, opts.length - begin), opts.gcContent, rng);
+    });
+
+    // Interspersed repeats: diverged copies of a few consensus sequences,
+    // on either strand
+    SplitMix64 rng(opts.seed ^ 0x5851f42d4c957f2dULL);
+    size_t repeatLength = std::min(opts.repeatLength, opts.length);
+    std::vector<std::string> families(opts.repeatFamilies, std::string(repeatLength, 'A'));
+    for (auto& family : families) randomBases(&family[0], repeatLength, opts.gcContent, rng);
+    size_t numCopies = repeatLength && !families.empty()
+        ? (size_t)(opts.repeatFraction * opts.length / repeatLength) : 0;
+    std::string copy;
+    for (size_t i = 0; i < numCopies; i++) {
+        copy = families[rng.below(families.size())];
+        if (rng.next() & 1) reverseComplement(copy);
+        mutate(&copy[0], copy.size(), opts.repeatDivergence, rng);
+        size_t at = rng.below(opts.length - repeatLength + 1);
+        std::copy(copy.begin(), copy.end(), genome.begin() + at);
+    }
+
+    // Microsatellites: a 1-6 base unit repeated over 20-300 bases
+    const size_t MEAN_TRACT = 160;
+    size_t numTracts = (size_t)(opts.tandemFraction * opts.length / MEAN_TRACT);
+    for (size_t i = 0; i < numTracts; i++) {
+        char unit[6];
+        size_t unitLength = 1 + rng.below(6);
+        randomBases(unit, unitLength, opts.gcContent, rng);
+        size_t tract = std::min<size_t>(20 + rng.below(281), opts.length);
+        size_t at = rng.below(opts.length - tract + 1);
+        for (size_t j = 0; j < tract; j++) genome[at + j] = unit[j % unitLength];
+    }
+    return genome;
+}
+
+inline size_t numReads(const std::string& genome, const ReadOptions& opts) {
+    if (genome.size() < opts.readLength || opts.readLength == 0) return 0;
+    return (size_t)(opts.coverage * genome.size() / opts.readLength);
+}
+
+// Reads are sampled in chunks of this many, each from its own seed
+constexpr size_t READS_PER_CHUNK = 16384;
+
+// Calls f(readIndex, bases, quality) for the reads of one chunk. Reads
+// start uniformly on either strand; substituted bases get quality '#',
+// the others 'I'.
+template <typename F>
+void sampleReadChunk(const std::string& genome, const ReadOptions& opts, size_t chunk, F f) {
+    size_t total = numReads(genome, opts);
+    size_t first = chunk * READS_PER_CHUNK;
+    size_t last = std::min(total, first + READS_PER_CHUNK);
+    SplitMix64 rng(opts.seed * 0x9e3779b97f4a7c15ULL + chunk);
+    std::string read, quality;
+    for (size_t r = first; r < last; r++) {
+        size_t start = rng.below(genome.size() - opts.readLength + 1);
+        read.assign(genome, start, opts.readLength);
+        if (rng.next() & 1) reverseComplement(read);
+        quality.assign(opts.readLength, 'I');
+        for (size_t i = rng.skip(opts.errorRate); i < read.size(); i += 1 + rng.skip(opts.errorRate)) {
+            read[i] = substituteBase(read[i], rng);
+            quality[i] = '#';
+        }
+        f(r, read, quality);
+    }
+}
+
+inline size_t numReadChunks(const std::string& genome, const ReadOptions& opts) {
+    return (numReads(genome, opts) + READS_PER_CHUNK - 1) / READS_PER_CHUNK;
+}
+
+// FASTA or FASTQ records of one chunk
+inline std::string formatReadChunk(const std::string& genome, const ReadOptions& opts, size_t chunk) {
+    std::string text;
+    text.reserve(READS_PER_CHUNK * (2 * opts.readLength + 32));
+    sampleReadChunk(genome, opts, chunk, [&](size_t r, const std::string& bases, const std::string& quality) {
+        text += opts.fastq ? '@' : '>';
+        text += 'r';
+        text += std::to_string(r);
+        text += '\n';
+        text += bases;
+        text += '\n';
+        if (opts.fastq) {
+            text += "+\n";
+            text += quality;
+            text += '\n';
+        }
+    });
+    return text;
+}
+
+// Formats chunks on the pool, a few per thread at a time, and writes them
+// in order. Returns the number of reads.
+inline size_t writeReads(const std::string& genome, const ReadOptions& opts, std::ostream& out,
+                         TaskPool& pool = TaskPool::global()) {
+    size_t chunks = numReadChunks(genome, opts);
+    size_t batch = 2 * pool.size();
+    std::vector<std::string> texts(batch);
+    for (size_t first = 0; first < chunks; first += batch) {
+        size_t n = std::min(batch, chunks - first);
+        pool.parallelFor(n, [&](size_t i) { texts[i] = formatReadChunk(genome, opts, first + i); });
+        for (size_t i = 0; i < n; i++) out.write(texts[i].data(), texts[i].size());
+    }
+    return numReads(genome, opts);
+}
+
+// The reference itself as FASTA, 80 bases per line
+inline void writeGenome(const std::string& genome, std::ostream& out, const std::string& name = "synthetic") {
+    const size_t LINE = 80;
+    out << ">" << name << "\n";
+    std::string text;
+    text.reserve(1 << 20);
+    for (size_t i = 0; i < genome.size(); i += LINE) {
+        text.append(genome, i, LINE);
+        text += '\n';
+        if (text.size() >= (1 << 20) - LINE) {
+            out.write(text.data(), text.size());
+            text.clear();
+        }
+    }
+    out.write(text.data(), text.size());
+}
+
+#endif
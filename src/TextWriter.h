@@ -0,0 +1,155 @@
+#ifndef TEXT_WRITER_H
+#define TEXT_WRITER_H
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <stdexcept>
+#include <algorithm>
+#include <cstdint>
+#include <fcntl.h>
+#include <unistd.h>
+#include "ThreadPool.h"
+
+// "kmer\tcount\n" output without iostreams: lines are formatted into large
+// buffers by hand and written in bulk
+
+inline int countDigits(uint64_t v) {
+    int n = 1;
+    while (v >= 100) {
+        v /= 100;
+        n += 2;
+    }
+    return n + (v >= 10);
+}
+
+// Writes v in decimal at out, returns the end
+inline char* formatUInt(char* out, uint64_t v) {
+    static const char pairs[] =
+        "0001020304050607080910111213141516171819202122232425262728293031323334353637383940414243444546474849"
+        "5051525354555657585960616263646566676869707172737475767778798081828384858687888990919293949596979899";
+    char* end = out + countDigits(v);
+    char* p = end;
+    while (v >= 100) {
+        unsigned i = (unsigned)(v % 100) * 2;
+        v /= 100;
+        *--p = pairs[i + 1];
+        *--p = pairs[i];
+    }
+    if (v >= 10) {
+        *--p = pairs[v * 2 + 1];
+        *--p = pairs[v * 2];
+    } else {
+        *--p = (char)('0' + v);
+    }
+    return end;
+}
+
+template <typename Traits>
+size_t lineSize(const typename Traits::Key& key, uint64_t count) {
+    return Traits::textSize(key) + countDigits(count) + 2;
+}
+
+template <typename Traits>
+char* formatLine(char* out, const typename Traits::Key& key, uint64_t count) {
+    out = Traits::formatKey(out, key);
+    *out++ = '\t';
+    out = formatUInt(out, count);
+    *out++ = '\n';
+    return out;
+}
+
+// A large local buffer of formatted lines
+template <typename Traits>
+class LineBuffer {
+    std::vector<char> buffer;
+    size_t used = 0;
+
+public:
+    explicit LineBuffer(size_t size = 4 << 20) : buffer(size) {}
+
+    // False if the line doesn't fit; hand over data() and clear() first
+    bool add(const typename Traits::Key& key, uint64_t count) {
+        size_t worst = Traits::textSize(key) + 22;
+        if (used + worst > buffer.size()) {
+            if (used > 0) return false;
+            buffer.resize(worst);
+        }
+        used = formatLine<Traits>(buffer.data() + used, key, count) - buffer.data();
+        return true;
+    }
+
+    const char* data() const { return buffer.data(); }
+    size_t size() const { return used; }
+    void clear() { used = 0; }
+};
+
+inline bool pwriteAll(int fd, const char* data, size_t n, off_t offset) {
+    while (n > 0) {
+        ssize_t w = pwrite(fd, data, n, offset);
+        if (w <= 0) return false;
+        data += w;
+        n -= w;
+        offset += w;
+    }
+    return true;
+}
+
+// Writes every entry of an unordered map as text in `threads` tasks on the
+// pool. The buckets are split into one contiguous range per task; a first
+// pass sizes each range so every task knows its file offset, then each task
+// formats its range and writes it with pwrite. Returns the lines written.
+template <typename Traits, typename Map>
+size_t writeTextParallel(const Map& map, const std::string& path, unsigned threads,
+                         TaskPool& pool = TaskPool::global()) {
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) throw std::runtime_error("Could not open " + path);
+
+    size_t buckets = map.bucket_count();
+    unsigned n = std::max<size_t>(1, std::min<size_t>(threads, buckets));
+    auto first = [&](unsigned t) { return buckets * t / n; };
+
+    auto parallel = [n, &pool](auto f) { pool.parallelFor(n, [&](size_t t) { f((unsigned)t); }); };
+
+    std::vector<size_t> bytes(n, 0);
+    parallel([&](unsigned t) {
+        size_t total = 0;
+        for (size_t b = first(t); b < first(t + 1); b++) {
+            for (auto it = map.begin(b); it != map.end(b); ++it) {
+                total += lineSize<Traits>(it->first, it->second);
+            }
+        }
+        bytes[t] = total;
+    });
+
+    std::vector<off_t> offsets(n + 1, 0);
+    for (unsigned t = 0; t < n; t++) offsets[t + 1] = offsets[t] + bytes[t];
+    bool ok = ftruncate(fd, offsets[n]) == 0;
+
+    std::atomic<bool> failed{!ok};
+    parallel([&](unsigned t) {
+        LineBuffer<Traits> lines;
+        off_t at = offsets[t];
+        auto flush = [&]() {
+            if (!pwriteAll(fd, lines.data(), lines.size(), at)) failed = true;
+            at += lines.size();
+            lines.clear();
+        };
+        for (size_t b = first(t); b < first(t + 1); b++) {
+            for (auto it = map.begin(b); it != map.end(b); ++it) {
+                if (!lines.add(it->first, it->second)) {
+                    flush();
+                    lines.add(it->first, it->second);
+                }
+            }
+        }
+        flush();
+    });
+
+    if (close(fd) != 0) failed = true;
+    if (failed) throw std::runtime_error("Could not write " + path);
+    return map.size();
+}
+
+#endif
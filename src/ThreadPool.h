@@ -0,0 +1,189 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <memory>
+#include <algorithm>
+#include <chrono>
+
+// Work-stealing task pool. Every thread has its own deque: tasks submitted
+// from a pool thread go to the back of its deque and it pops from the back
+// (newest first, cache-warm); idle threads steal from the front of the
+// others' deques (oldest first). Tasks from outside the pool are spread
+// over the deques round-robin. Tasks must not block on each other; a
+// thread waiting for tasks (TaskGroup::wait, parallelFor) runs pending
+// tasks meanwhile instead of sleeping.
+class TaskPool {
+public:
+    using Task = std::function<void()>;
+
+private:
+    struct Deque {
+        std::mutex lock;
+        std::deque<Task> tasks;
+    };
+
+    std::vector<std::unique_ptr<Deque>> deques;
+    std::vector<std::thread> threads;
+    std::atomic<size_t> queued{0};
+    std::atomic<size_t> nextDeque{0};
+    std::mutex sleepLock;
+    std::condition_variable wake;
+    bool stopping = false;
+
+    // Index of the calling thread in this pool, or -1
+    int self() const {
+        return current().first == this ? current().second : -1;
+    }
+
+    static std::pair<const TaskPool*, int>& current() {
+        static thread_local std::pair<const TaskPool*, int> slot{nullptr, -1};
+        return slot;
+    }
+
+    // Own deque from the back, then the others from the front
+    bool take(int home, Task& task) {
+        size_t n = deques.size();
+        size_t start = home >= 0 ? home : nextDeque.load(std::memory_order_relaxed) % n;
+        for (size_t i = 0; i < n; i++) {
+            Deque& d = *deques[(start + i) % n];
+            std::lock_guard<std::mutex> guard(d.lock);
+            if (d.tasks.empty()) continue;
+            if (i == 0 && home >= 0) {
+                task = std::move(d.tasks.back());
+                d.tasks.pop_back();
+            } else {
+                task = std::move(d.tasks.front());
+                d.tasks.pop_front();
+            }
+            queued.fetch_sub(1);
+            return true;
+        }
+        return false;
+    }
+
+    void run(int index) {
+        current() = {this, index};
+        Task task;
+        while (true) {
+            if (take(index, task)) {
+                task();
+                task = nullptr;
+                continue;
+            }
+            std::unique_lock<std::mutex> guard(sleepLock);
+            wake.wait(guard, [this]() { return queued.load() > 0 || stopping; });
+            if (stopping && queued.load() == 0) return;
+        }
+    }
+
+public:
+    explicit TaskPool(unsigned numThreads) {
+        unsigned n = std::max(1u, numThreads);
+        for (unsigned i = 0; i < n; i++) deques.push_back(std::make_unique<Deque>());
+        for (unsigned i = 0; i < n; i++) threads.emplace_back(&TaskPool::run, this, (int)i);
+    }
+
+    // Runs what is still queued, then joins
+    ~TaskPool() {
+        {
+            std::lock_guard<std::mutex> guard(sleepLock);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& t : threads) t.join();
+    }
+
+    TaskPool(const TaskPool&) = delete;
+    TaskPool& operator=(const TaskPool&) = delete;
+
+    unsigned size() const { return threads.size(); }
+
+    void submit(Task task) {
+        int home = self();
+        size_t d = home >= 0 ? home : nextDeque.fetch_add(1, std::memory_order_relaxed) % deques.size();
+        {
+            std::lock_guard<std::mutex> guard(deques[d]->lock);
+            deques[d]->tasks.push_back(std::move(task));
+        }
+        queued.fetch_add(1);
+        // Taking the lock orders the count with a sleeper's predicate check
+        { std::lock_guard<std::mutex> guard(sleepLock); }
+        wake.notify_one();
+    }
+
+    // Runs one pending task on the calling thread; false if there was none
+    bool runOne() {
+        Task task;
+        if (!take(self(), task)) return false;
+        task();
+        return true;
+    }
+
+    // f(i) for i in [0, n), one task each; returns when all are done
+    template <typename F>
+    void parallelFor(size_t n, F f);
+
+    // Shared pool for parallel loops. Sized on first use, from
+    // setGlobalThreads() if it was called before, else the number of CPUs.
+    static TaskPool& global() {
+        static TaskPool pool(globalThreads() ? globalThreads() : std::thread::hardware_concurrency());
+        return pool;
+    }
+
+    static void setGlobalThreads(unsigned n) { globalThreads() = n; }
+
+private:
+    static unsigned& globalThreads() {
+        static unsigned n = 0;
+        return n;
+    }
+};
+
+// Tasks that can be waited for together
+class TaskGroup {
+    TaskPool& pool;
+    std::atomic<size_t> pending{0};
+    std::mutex lock;
+    std::condition_variable done;
+
+public:
+    explicit TaskGroup(TaskPool& pool) : pool(pool) {}
+    ~TaskGroup() { wait(); }
+
+    void run(TaskPool::Task task) {
+        pending.fetch_add(1);
+        pool.submit([this, task = std::move(task)]() {
+            task();
+            // Under the lock, so wait() can't return (and the group go
+            // away) before this is done with it
+            std::lock_guard<std::mutex> guard(lock);
+            if (pending.fetch_sub(1) == 1) done.notify_all();
+        });
+    }
+
+    // Helps with pending tasks until this group's are finished
+    void wait() {
+        while (pending.load() > 0) {
+            if (pool.runOne()) continue;
+            std::unique_lock<std::mutex> guard(lock);
+            done.wait_for(guard, std::chrono::milliseconds(1), [this]() { return pending.load() == 0; });
+        }
+        std::lock_guard<std::mutex> guard(lock);
+    }
+};
+
+template <typename F>
+void TaskPool::parallelFor(size_t n, F f) {
+    TaskGroup group(*this);
+    for (size_t i = 0; i < n; i++) group.run([&f, i]() { f(i); });
+    group.wait();
+}
+
+#endif
@@ -0,0 +1,130 @@
+#ifndef TOP_N_H
+#define TOP_N_H
+
+#include <vector>
+#include <queue>
+#include <unordered_map>
+#include <algorithm>
+#include <cstdint>
+
+// The N most frequent k-mers. Ties are broken by k-mer so the result does
+// not depend on the order entries are seen in.
+template <typename Key>
+struct TopEntry {
+    Key key;
+    uint64_t count;
+    uint64_t error;  // overestimate bound (Space-Saving only)
+};
+
+template <typename Key>
+bool betterEntry(const TopEntry<Key>& a, const TopEntry<Key>& b) {
+    return a.count != b.count ? a.count > b.count : a.key < b.key;
+}
+
+// Keeps the best n entries offered; the worst kept entry is on top
+template <typename Key>
+class TopHeap {
+    struct Worse {
+        bool operator()(const TopEntry<Key>& a, const TopEntry<Key>& b) const {
+            return betterEntry(a, b);
+        }
+    };
+
+    size_t n;
+    std::priority_queue<TopEntry<Key>, std::vector<TopEntry<Key>>, Worse> heap;
+
+public:
+    explicit TopHeap(size_t n) : n(n) {}
+
+    void offer(const Key& key, uint64_t count, uint64_t error = 0) {
+        if (n == 0) return;
+        TopEntry<Key> e{key, count, error};
+        if (heap.size() < n) {
+            heap.push(e);
+        } else if (betterEntry(e, heap.top())) {
+            heap.pop();
+            heap.push(e);
+        }
+    }
+
+    // Best first; empties the heap
+    std::vector<TopEntry<Key>> take() {
+        std::vector<TopEntry<Key>> out;
+        while (!heap.empty()) {
+            out.push_back(heap.top());
+            heap.pop();
+        }
+        std::reverse(out.begin(), out.end());
+        return out;
+    }
+};
+
+// Space-Saving (Metwally et al.): at most `capacity` counters. An unseen
+// key takes over the smallest counter and inherits its count as error, so
+// every count is an overestimate by at most `error`, and any key seen more
+// than total / capacity times is guaranteed to be kept. Counters sit in an
+// indexed min-heap ordered by count.
+template <typename Traits>
+class SpaceSaving {
+    using Key = typename Traits::Key;
+
+    size_t capacity;
+    std::vector<TopEntry<Key>> heap;
+    std::unordered_map<Key, size_t, typename Traits::KeyHash> slot;  // key -> heap index
+
+    void swapEntries(size_t a, size_t b) {
+        std::swap(heap[a], heap[b]);
+        slot[heap[a].key] = a;
+        slot[heap[b].key] = b;
+    }
+
+    // Count at i went up: move it down towards the leaves
+    void siftDown(size_t i) {
+        while (true) {
+            size_t smallest = i;
+            size_t l = 2 * i + 1, r = l + 1;
+            if (l < heap.size() && heap[l].count < heap[smallest].count) smallest = l;
+            if (r < heap.size() && heap[r].count < heap[smallest].count) smallest = r;
+            if (smallest == i) return;
+            swapEntries(i, smallest);
+            i = smallest;
+        }
+    }
+
+    void siftUp(size_t i) {
+        while (i > 0 && heap[(i - 1) / 2].count > heap[i].count) {
+            swapEntries(i, (i - 1) / 2);
+            i = (i - 1) / 2;
+        }
+    }
+
+public:
+    explicit SpaceSaving(size_t capacity) : capacity(std::max<size_t>(capacity, 1)) {
+        heap.reserve(this->capacity);
+        slot.reserve(this->capacity);
+    }
+
+    void add(const Key& key) {
+        auto it = slot.find(key);
+        if (it != slot.end()) {
+            size_t i = it->second;
+            heap[i].count++;
+            siftDown(i);
+        } else if (heap.size() < capacity) {
+            heap.push_back({key, 1, 0});
+            slot[key] = heap.size() - 1;
+            siftUp(heap.size() - 1);
+        } else {
+            // Replace the minimum
+            slot.erase(heap[0].key);
+            uint64_t min = heap[0].count;
+            heap[0] = {key, min + 1, min};
+            slot[key] = 0;
+            siftDown(0);
+        }
+    }
+
+    const std::vector<TopEntry<Key>>& entries() const { return heap; }
+};
+
+#endif
@@ -0,0 +1,419 @@
+// Benchmark suite: the pipeline's kernels in isolation, then whole
+// pipeline runs over a matrix of k, m, threads and input sizes. Datasets
+// are generated from fixed seeds, so runs on the same machine compare.
+//
+//   g++ -std=c++17 -pthread -O3 -o benchmark benchmark.cpp Hasher.cpp -lz
+//   ./benchmark [--quick] [--repeats n] [--filter text] [--out bench.json]
+//               [--pipeline ./pipeline | --no-pipeline] [--baseline old.json]
+//   ./benchmark --compare old.json new.json [--tolerance 0.10]
+//
+// Every benchmark reports the median time of its repeats. Comparing flags
+// those more than `tolerance` slower than the baseline and exits with 1.
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <random>
+#include <thread>
+#include <functional>
+#include <algorithm>
+#include <cstdlib>
+#include <cstdio>
+#include <unistd.h>
+#include "Hasher.h"
+#include "KmerEngine.h"
+#include "QuadraticHashTable.h"
+#include "StageStats.h"
+#include "SyntheticGenome.h"
+#include "AsyncIO.h"
+
+using Traits31 = PackedKmerTraits<31>;
+
+struct BenchResult {
+    std::string name;
+    double seconds;   // median over the repeats
+    uint64_t items;   // k-mers, bases or inserts per repeat
+};
+
+struct BenchOptions {
+    bool quick = false;
+    int repeats = 3;
+    std::string filter;
+    std::string outPath = "bench.json";
+    std::string pipeline = "./pipeline";
+    bool runPipeline = true;
+    std::string baseline;
+    double tolerance = 0.10;
+};
+
+// Synthetic genome a tenth of `length` bases (SyntheticGenome.h), so
+// reads cover it about ten times with repeats and errors like real data
+GenomeOptions benchGenome(size_t length, uint64_t seed) {
+    GenomeOptions genome;
+    genome.length = std::max<size_t>(length / 10, 100000);
+    genome.seed = seed;
+    return genome;
+}
+
+// `length` bases of reads from benchGenome, separated like FASTQ records
+// in a bundle
+std::string sampledReads(size_t length, uint64_t seed) {
+    std::string genome = buildGenome(benchGenome(length, seed));
+    ReadOptions readOpts;
+    readOpts.seed = seed + 1;
+    std::string reads;
+    reads.reserve(numReads(genome, readOpts) * (readOpts.readLength + 1));
+    for (size_t c = 0; c < numReadChunks(genome, readOpts); c++) {
+        sampleReadChunk(genome, readOpts, c, [&](size_t, const std::string& bases, const std::string&) {
+            reads += bases;
+            reads += RECORD_SEPARATOR;
+        });
+    }
+    return reads;
+}
+
+class Bench {
+    BenchOptions opts;
+    std::vector<BenchResult> results;
+
+public:
+    explicit Bench(const BenchOptions& opts) : opts(opts) {}
+
+    const std::vector<BenchResult>& getResults() const { return results; }
+
+    // Runs f (which returns the seconds it measured) `repeats` times
+    void run(const std::string& name, uint64_t items, const std::function<double()>& f) {
+        if (!opts.filter.empty() && name.find(opts.filter) == std::string::npos) return;
+        std::vector<double> times;
+        for (int r = 0; r < opts.repeats; r++) times.push_back(f());
+        std::sort(times.begin(), times.end());
+        double median = times[times.size() / 2];
+        results.push_back({name, median, items});
+        std::cout << "  " << name << ": " << median * 1e3 << " ms";
+        if (items && median > 0) std::cout << " (" << items / median / 1e6 << " M/s)";
+        std::cout << "\n";
+    }
+};
+
+template <typename F>
+double timeIt(F f) {
+    uint64_t start = wallNs();
+    f();
+    return (wallNs() - start) / 1e9;
+}
+
+// Super-mers of a sequence, then their expansion into packed k-mers
+template <int K>
+void benchEngine(Bench& bench, const std::string& reads, int m) {
+    using Traits = PackedKmerTraits<K>;
+    KmerEngine<Traits> engine(K, m);
+    std::string tag = "k=" + std::to_string(K) + ",m=" + std::to_string(m);
+
+    bench.run("supermers/" + tag, reads.size(), [&]() {
+        return timeIt([&]() { volatile size_t n = engine.superMers(reads).size(); (void)n; });
+    });
+
+    std::vector<SuperMer> superMers = engine.superMers(reads);
+    uint64_t numKmers = 0;
+    for (const auto& sm : superMers) {
+        if (sm.bases.size() >= (size_t)K) numKmers += sm.bases.size() - K + 1;
+    }
+    bench.run("expand/" + tag, numKmers, [&]() {
+        std::vector<typename Traits::Key> kmers;
+        kmers.reserve(numKmers);
+        return timeIt([&]() {
+            for (const auto& sm : superMers) engine.expand(sm.bases, kmers);
+        });
+    });
+}
+
+// String k-mers (the generic engine's representation), for comparison
+void benchStringExpand(Bench& bench, const std::string& reads, int k) {
+    std::string seq = reads.substr(0, std::min<size_t>(reads.size(), 1 << 20));
+    seq.erase(std::remove(seq.begin(), seq.end(), RECORD_SEPARATOR), seq.end());
+    KmerEngine<StringKmerTraits> engine(k, 15);
+    bench.run("expand_string/k=" + std::to_string(k), seq.size() - k + 1, [&]() {
+        std::vector<std::string> kmers;
+        return timeIt([&]() { engine.expand(seq, kmers); });
+    });
+}
+
+// Inserting keys that are already in a table filled to `load`: the probe
+// sequence a repeated k-mer walks once the table is that full
+void benchTable(Bench& bench, size_t numKeys, double load) {
+    std::mt19937_64 rng(7);
+    std::vector<uint64_t> keys(numKeys);
+    for (auto& key : keys) key = rng() & Traits31::MASK;
+    size_t slots = (size_t)(numKeys / load) | 1;
+
+    BasicQuadraticHashTable<Traits31> table(slots, 100);
+    for (uint64_t key : keys) table.insert(key);
+    std::shuffle(keys.begin(), keys.end(), rng);
+
+    char tag[32];
+    std::snprintf(tag, sizeof(tag), "load=%.2f", load);
+    bench.run(std::string("table_insert/") + tag, numKeys, [&]() {
+        return timeIt([&]() {
+            for (uint64_t key : keys) table.insert(key);
+        });
+    });
+}
+
+// Routed hasher with dedicated worker threads, fed pre-built blocks
+double hashBlocks(const std::vector<std::vector<uint64_t>>& perWorker, unsigned threads, size_t tableSize,
+                  BasicHasher<Traits31>* keep = nullptr) {
+    BasicHasher<Traits31> local(threads, tableSize, 100);
+    BasicHasher<Traits31>& hasher = keep ? *keep : local;
+    const size_t BLOCK = 4096;
+
+    uint64_t start = wallNs();
+    std::vector<std::thread> workers;
+    for (unsigned t = 0; t < threads; t++) workers.emplace_back(&BasicHasher<Traits31>::worker, &hasher, t);
+    for (unsigned t = 0; t < threads; t++) {
+        const auto& keys = perWorker[t];
+        for (size_t i = 0; i < keys.size(); i += BLOCK) {
+            auto* block = new BasicKmerBlock<uint64_t>(BLOCK);
+            block->kmers.assign(keys.begin() + i, keys.begin() + std::min(keys.size(), i + BLOCK));
+            hasher.submit(t, block);
+        }
+    }
+    hasher.signalComplete();
+    for (auto& w : workers) w.join();
+    return (wallNs() - start) / 1e9;
+}
+
+// Keys with ~10x repetition, split over workers by hash like the balancer
+std::vector<std::vector<uint64_t>> workerKeys(size_t numKmers, unsigned threads) {
+    std::mt19937_64 rng(11);
+    std::vector<uint64_t> distinct(numKmers / 10);
+    for (auto& key : distinct) key = rng() & Traits31::MASK;
+    std::vector<std::vector<uint64_t>> perWorker(threads);
+    for (size_t i = 0; i < numKmers; i++) {
+        uint64_t key = distinct[rng() % distinct.size()];
+        perWorker[Traits31::hash(key) % threads].push_back(key);
+    }
+    return perWorker;
+}
+
+void benchHasher(Bench& bench, size_t numKmers, const std::vector<unsigned>& threadCounts) {
+    size_t tableSize = numKmers / 10 * 2;
+    for (unsigned threads : threadCounts) {
+        auto perWorker = workerKeys(numKmers, threads);
+        bench.run("hasher/threads=" + std::to_string(threads), numKmers, [&]() {
+            return hashBlocks(perWorker, threads, tableSize / threads + 1);
+        });
+    }
+}
+
+// mergeResults and both output formats on one counted dataset
+void benchMergeOutput(Bench& bench, size_t numKmers, unsigned threads, const std::string& dir) {
+    auto perWorker = workerKeys(numKmers, threads);
+    size_t tableSize = numKmers / 10 * 2 / threads + 1;
+    std::string path = dir + "/bench_output";
+
+    bench.run("merge", numKmers / 10, [&]() {
+        BasicHasher<Traits31> hasher(threads, tableSize, 100);
+        hashBlocks(perWorker, threads, tableSize, &hasher);
+        return timeIt([&]() { hasher.mergeResults(); });
+    });
+
+    BasicHasher<Traits31> hasher(threads, tableSize, 100);
+    hashBlocks(perWorker, threads, tableSize, &hasher);
+    hasher.mergeResults();
+    bench.run("output/text", numKmers / 10, [&]() {
+        return timeIt([&]() { hasher.writeResults(path + ".txt"); });
+    });
+    bench.run("output/compressed", numKmers / 10, [&]() {
+        return timeIt([&]() { hasher.writeCompressed(path + ".kcb"); });
+    });
+    std::remove((path + ".txt").c_str());
+    std::remove((path + ".kcb").c_str());
+}
+
+// Whole pipeline runs on FASTA files written to dir
+void benchPipeline(Bench& bench, const BenchOptions& opts, const std::string& dir) {
+    std::string exe = opts.pipeline;
+    if (exe.find('/') == std::string::npos) exe = "./" + exe;
+    char resolved[4096];
+    if (!realpath(exe.c_str(), resolved) || access(resolved, X_OK) != 0) {
+        std::cout << "  (skipped: no pipeline binary at " << opts.pipeline << ")\n";
+        return;
+    }
+
+    std::vector<size_t> sizes = opts.quick ? std::vector<size_t>{1 << 22} : std::vector<size_t>{1 << 22, 1 << 24};
+    std::vector<std::pair<int, int>> kms = opts.quick ? std::vector<std::pair<int, int>>{{31, 15}}
+                                                      : std::vector<std::pair<int, int>>{{21, 11}, {31, 15}, {63, 21}};
+    std::vector<unsigned> threadCounts = opts.quick ? std::vector<unsigned>{2} : std::vector<unsigned>{1, 4};
+
+    for (size_t size : sizes) {
+        std::string fasta = dir + "/bench_" + std::to_string(size) + ".fa";
+        {
+            ReadOptions readOpts;
+            readOpts.seed = size + 1;
+            AsyncOFStream out(fasta);
+            writeReads(buildGenome(benchGenome(size, size)), readOpts, out);
+        }
+        for (auto [k, m] : kms) {
+            for (unsigned threads : threadCounts) {
+                std::string name = "pipeline/k=" + std::to_string(k) + ",m=" + std::to_string(m) +
+                                   ",threads=" + std::to_string(threads) + ",bases=" + std::to_string(size);
+                std::string command = "cd '" + dir + "' && '" + resolved + "' '" + fasta + "' " +
+                                      std::to_string(k) + " " + std::to_string(m) + " " +
+                                      std::to_string(threads) + " > /dev/null 2>&1";
+                bench.run(name, size, [&]() {
+                    double seconds = timeIt([&]() {
+                        if (std::system(command.c_str()) != 0) std::cerr << "  failed: " << command << "\n";
+                    });
+                    return seconds;
+                });
+            }
+        }
+        std::remove(fasta.c_str());
+    }
+    std::remove((dir + "/output.txt").c_str());
+}
+
+void writeResults(const std::string& path, const BenchOptions& opts, const std::vector<BenchResult>& results) {
+    std::ofstream file(path);
+    JsonWriter json(file);
+    json.field("quick", opts.quick);
+    json.field("repeats", opts.repeats);
+    json.field("hardware_threads", std::thread::hardware_concurrency());
+    json.beginArray("benchmarks");
+    for (const auto& r : results) {
+        json.beginObject();
+        json.field("name", r.name);
+        json.field("seconds", r.seconds);
+        json.field("items", r.items);
+        json.field("items_per_s", r.seconds > 0 ? r.items / r.seconds : 0);
+        json.endObject();
+    }
+    json.endArray();
+    json.close();
+}
+
+// name -> seconds from a file written by writeResults
+std::map<std::string, double> readResults(const std::string& path) {
+    std::ifstream in(path);
+    std::stringstream buffer;
+    buffer << in.rdbuf();
+    std::string text = buffer.str();
+
+    std::map<std::string, double> times;
+    const std::string NAME = "\"name\": \"", SECONDS = "\"seconds\": ";
+    for (size_t pos = 0; (pos = text.find(NAME, pos)) != std::string::npos;) {
+        pos += NAME.size();
+        std::string name = text.substr(pos, text.find('"', pos) - pos);
+        size_t at = text.find(SECONDS, pos);
+        if (at == std::string::npos) break;
+        times[name] = std::atof(text.c_str() + at + SECONDS.size());
+    }
+    return times;
+}
+
+// Prints every benchmark in both; true if none is slower by more than
+// the tolerance
+bool compareResults(const std::map<std::string, double>& baseline,
+                    const std::map<std::string, double>& current, double tolerance) {
+    int regressions = 0;
+    std::cout << "Comparing against baseline (tolerance " << tolerance * 100 << "%):\n";
+    for (const auto& [name, seconds] : current) {
+        auto it = baseline.find(name);
+        if (it == baseline.end() || it->second <= 0) {
+            std::cout << "  " << name << ": new\n";
+            continue;
+        }
+        double change = seconds / it->second - 1;
+        bool slower = change > tolerance;
+        regressions += slower;
+        std::cout << "  " << name << ": " << it->second * 1e3 << " -> " << seconds * 1e3 << " ms ("
+                  << (change >= 0 ? "+" : "") << change * 100 << "%)" << (slower ? "  REGRESSION" : "") << "\n";
+    }
+    std::cout << (regressions ? std::to_string(regressions) + " regression(s)\n" : "No regressions\n");
+    return regressions == 0;
+}
+
+int main(int argc, char** argv) {
+    BenchOptions opts;
+    std::string compareOld, compareNew;
+    for (int i = 1; i < argc; i++) {
+        std::string flag = argv[i];
+        if (flag == "--quick") {
+            opts.quick = true;
+            opts.repeats = 1;
+        } else if (flag == "--repeats" && i + 1 < argc) {
+            opts.repeats = std::max(1, std::stoi(argv[++i]));
+        } else if (flag == "--filter" && i + 1 < argc) {
+            opts.filter = argv[++i];
+        } else if (flag == "--out" && i + 1 < argc) {
+            opts.outPath = argv[++i];
+        } else if (flag == "--pipeline" && i + 1 < argc) {
+            opts.pipeline = argv[++i];
+        } else if (flag == "--no-pipeline") {
+            opts.runPipeline = false;
+        } else if (flag == "--baseline" && i + 1 < argc) {
+            opts.baseline = argv[++i];
+        } else if (flag == "--tolerance" && i + 1 < argc) {
+            opts.tolerance = std::stod(argv[++i]);
+        } else if (flag == "--compare" && i + 2 < argc) {
+            compareOld = argv[++i];
+            compareNew = argv[++i];
+        } else {
+            std::cerr << "Unknown option: " << flag << "\n";
+            return 2;
+        }
+    }
+
+    if (!compareOld.empty()) {
+        auto baseline = readResults(compareOld);
+        auto current = readResults(compareNew);
+        if (baseline.empty() || current.empty()) {
+            std::cerr << "No benchmark results in " << (baseline.empty() ? compareOld : compareNew) << "\n";
+            return 2;
+        }
+        return compareResults(baseline, current, opts.tolerance) ? 0 : 1;
+    }
+
+    const char* tmp = std::getenv("TMPDIR");
+    std::string dirTemplate = std::string(tmp && *tmp ? tmp : "/tmp") + "/kmer_bench_XXXXXX";
+    if (!mkdtemp(&dirTemplate[0])) {
+        std::cerr << "Could not create a directory in " << (tmp ? tmp : "/tmp") << "\n";
+        return 2;
+    }
+    std::string dir = dirTemplate;
+
+    Bench bench(opts);
+    size_t bases = opts.quick ? 1 << 22 : 1 << 24;
+    size_t kmers = opts.quick ? 1 << 22 : 1 << 24;
+    std::string reads = sampledReads(bases, 42);
+
+    std::cout << "=== Kernels ===\n";
+    benchEngine<31>(bench, reads, 11);
+    benchEngine<31>(bench, reads, 15);
+    benchEngine<31>(bench, reads, 21);
+    benchEngine<63>(bench, reads, 21);
+    benchStringExpand(bench, reads, 31);
+    for (double load : {0.25, 0.5, 0.75, 0.9}) benchTable(bench, opts.quick ? 1 << 20 : 1 << 22, load);
+    benchHasher(bench, kmers, opts.quick ? std::vector<unsigned>{1, 2} : std::vector<unsigned>{1, 2, 4, 8});
+    benchMergeOutput(bench, kmers, 4, dir);
+
+    if (opts.runPipeline) {
+        std::cout << "=== Pipeline ===\n";
+        benchPipeline(bench, opts, dir);
+    }
+    rmdir(dir.c_str());
+
+    writeResults(opts.outPath, opts, bench.getResults());
+    std::cout << "Results written to " << opts.outPath << "\n";
+
+    if (!opts.baseline.empty()) {
+        auto baseline = readResults(opts.baseline);
+        std::map<std::string, double> current;
+        for (const auto& r : bench.getResults()) current[r.name] = r.seconds;
+        return compareResults(baseline, current, opts.tolerance) ? 0 : 1;
+    }
+    return 0;
+}
@@ -0,0 +1,167 @@
+// Set operations over count files written by `pipeline --format compressed`
+// (CountMerge.h)
+//
+//   g++ -std=c++17 -pthread -O3 -o combine combine.cpp
+//   ./combine <output> <input.kcb>... [options]
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include <cstdio>
+#include "Kmer.h"
+#include "CountMerge.h"
+#include "TextWriter.h"
+#include "AsyncIO.h"
+
+struct CombineOptions {
+    std::string output;
+    std::vector<std::string> inputs;
+    bool text = false;  // "kmer\tcount" lines instead of a count file
+    unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+    MergeOptions merge;
+};
+
+// Writes to a temporary file renamed over the output at the end, so an
+// input can also be the output
+template <typename Traits>
+size_t combine(const CombineOptions& opts) {
+    using Record = typename CountMerge<Traits>::Record;
+    std::vector<std::unique_ptr<CountFileReader<Traits>>> readers;
+    std::vector<const CountFileReader<Traits>*> inputs;
+    size_t inputRecords = 0;
+    for (const auto& path : opts.inputs) {
+        readers.push_back(std::make_unique<CountFileReader<Traits>>(path));
+        inputs.push_back(readers.back().get());
+        inputRecords += readers.back()->size();
+    }
+    CountMerge<Traits> merge(inputs, opts.merge);
+    std::cout << inputs.size() << " inputs, " << inputRecords << " records, " << merge.numSegments()
+              << " segments\n";
+
+    std::string writePath = opts.output + ".tmp";
+    size_t written;
+    if (opts.text) {
+        AsyncOFStream out(writePath);
+        LineBuffer<Traits> lines;
+        written = merge.run([&](const std::vector<Record>& records) {
+            for (const auto& [key, count] : records) {
+                if (!lines.add(key, count)) {
+                    out.write(lines.data(), lines.size());
+                    lines.clear();
+                    lines.add(key, count);
+                }
+            }
+        }, opts.threads);
+        out.write(lines.data(), lines.size());
+        out.close();
+        if (!out) throw std::runtime_error("Could not write " + writePath);
+    } else {
+        // Whole blocks are encoded in parallel; the rest waits for the next batch
+        const size_t BLOCK = 4096;
+        CountFileWriter<Traits> writer(writePath, BLOCK);
+        std::vector<Record> pending;
+        auto flush = [&](bool last) {
+            size_t n = last ? pending.size() : pending.size() / BLOCK * BLOCK;
+            writer.addSorted(pending.data(), n, opts.threads);
+            pending.erase(pending.begin(), pending.begin() + n);
+        };
+        written = merge.run([&](const std::vector<Record>& records) {
+            pending.insert(pending.end(), records.begin(), records.end());
+            if (pending.size() >= BLOCK * 4 * opts.threads) flush(false);
+        }, opts.threads);
+        flush(true);
+        writer.close();
+    }
+    if (std::rename(writePath.c_str(), opts.output.c_str()) != 0) {
+        throw std::runtime_error("Could not replace " + opts.output);
+    }
+    return written;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        std::cout << "Usage: ./combine <output> <input.kcb>... [options]\n"
+                  << "  Inputs are output.kcb files of `pipeline --format compressed` with the same k.\n"
+                  << "  Output is \"kmer<TAB>count\" lines if the name ends in .txt, a count file otherwise.\n\n"
+                  << "  --op <union|intersect|difference>  k-mers in any input, in all, or in the first\n"
+                  << "                                     and no other (default union)\n"
+                  << "  --count <sum|min|max>              combined count over the inputs with the k-mer\n"
+                  << "                                     (default sum)\n"
+                  << "  --min-inputs <n>                   only k-mers present in at least n inputs\n"
+                  << "  --input-min-count <n>              lower counts in an input count as absent\n"
+                  << "  --min-count <n>                    only combined counts of at least n\n"
+                  << "  --max-count <n>                    only combined counts of at most n\n"
+                  << "  --threads <n>                      merge threads (default: all CPUs)\n";
+        return 1;
+    }
+
+    CombineOptions opts;
+    opts.output = argv[1];
+    opts.text = opts.output.size() >= 4 && opts.output.compare(opts.output.size() - 4, 4, ".txt") == 0;
+    int i = 2;
+    for (; i < argc && std::string(argv[i]).compare(0, 2, "--") != 0; i++) opts.inputs.push_back(argv[i]);
+
+    for (; i < argc; i++) {
+        std::string flag = argv[i];
+        if (i + 1 >= argc) {
+            std::cerr << "Unknown option: " << flag << "\n";
+            return 1;
+        }
+        std::string value = argv[++i];
+        if (flag == "--op") {
+            if (!parseSetOp(value, opts.merge.set)) {
+                std::cerr << "Unknown set operation: " << value << "\n";
+                return 1;
+            }
+        } else if (flag == "--count") {
+            if (!parseCountOp(value, opts.merge.combine)) {
+                std::cerr << "Unknown count operation: " << value << "\n";
+                return 1;
+            }
+        }
+        else if (flag == "--min-inputs") opts.merge.minInputs = std::stoull(value);
+        else if (flag == "--input-min-count") opts.merge.inputMinCount = std::max(1ULL, std::stoull(value));
+        else if (flag == "--min-count") opts.merge.minCount = std::max(1ULL, std::stoull(value));
+        else if (flag == "--max-count") opts.merge.maxCount = std::stoull(value);
+        else if (flag == "--threads") opts.threads = std::max(1, std::stoi(value));
+        else {
+            std::cerr << "Unknown option: " << flag << "\n";
+            return 1;
+        }
+    }
+    if (opts.inputs.empty()) {
+        std::cerr << "No input files\n";
+        return 1;
+    }
+    TaskPool::setGlobalThreads(opts.threads);
+
+    uint32_t k = countFileK(opts.inputs[0]);
+    if (k == 0) {
+        std::cerr << opts.inputs[0] << " is not a count file\n";
+        return 1;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    size_t written = 0;
+    try {
+        switch (k) {
+#define DISPATCH_K(K) case K: written = combine<PackedKmerTraits<K>>(opts); break;
+            KMER_SPECIALIZATIONS(DISPATCH_K)
+#undef DISPATCH_K
+            default:
+                std::cerr << opts.inputs[0] << " holds k = " << k << ", which has no packed engine\n";
+                return 1;
+        }
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Wrote " << written << " k-mers to " << opts.output << " in " << seconds << " s\n";
+    return 0;
+}
@@ -3,18 +3,38 @@
 
 #include <vector>
 #include <string>
-
-// Kmer block structure for batch processing
-struct KmerBlock {
-    std::vector<std::string> kmers;
-
-    KmerBlock(size_t expectedKmers) {
+#include <cstdint>
+#include <utility>
+
+// Kmer block structure for batch processing. Key is std::string for the
+// generic engine or a packed word for the k-specialized engines.
+template <typename Key>
+struct BasicKmerBlock {
+    std::vector<Key> kmers;
+    // Optional (partition, end offset) runs of k-mers, for engines picked
+    // per partition; k-mers past the last segment have no partition
+    std::vector<std::pair<uint32_t, uint32_t>> segments;
+
+    BasicKmerBlock(size_t expectedKmers) {
         kmers.reserve(expectedKmers);
     }
 
-    KmerBlock() = default;
+    BasicKmerBlock() = default;
+};
+
+using KmerBlock = BasicKmerBlock<std::string>;
+
+// A super-mer and the minimizer all of its k-mers share. The minimizer is
+// stored as its rank under the active MinimizerOrder, which identifies the
+// super-mer's bucket.
+struct SuperMer {
+    std::string bases;
+    uint64_t minimizer;
 };
 
+// Separates reads (FASTQ records) inside a bundle. Never part of a k-mer.
+constexpr char RECORD_SEPARATOR = '\n';
+
 // A "bundle" is just a block of raw bytes
 struct FastBundle {
     std::vector<char> data;
@@ -0,0 +1,95 @@
+// Synthetic reads for testing and benchmarking (SyntheticGenome.h)
+//
+//   g++ -std=c++17 -pthread -O3 -o generate generate.cpp
+//   ./generate <out.fa|out.fq> [options]
+
+#include <iostream>
+#include <string>
+#include <chrono>
+#include "SyntheticGenome.h"
+#include "MemoryBudget.h"
+#include "AsyncIO.h"
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::cout << "Usage: ./generate <output> [options]\n"
+                  << "  Output is FASTQ if the name ends in .fq or .fastq, FASTA otherwise.\n"
+                  << "  Sizes take K, M and G suffixes.\n\n"
+                  << "  --genome <bases>          reference length (default 10M)\n"
+                  << "  --coverage <x>            read depth (default 10)\n"
+                  << "  --read-length <n>         bases per read (default 150)\n"
+                  << "  --error-rate <p>          per-base substitution rate (default 0.001)\n"
+                  << "  --repeats <fraction>      genome share of interspersed repeats (default 0.15)\n"
+                  << "  --repeat-length <n>       repeat family length (default 2000)\n"
+                  << "  --repeat-families <n>     number of repeat families (default 50)\n"
+                  << "  --divergence <p>          substitution rate between repeat copies (default 0.02)\n"
+                  << "  --tandem <fraction>       genome share of microsatellites (default 0.02)\n"
+                  << "  --gc <fraction>           GC content (default 0.41)\n"
+                  << "  --seed <n>                random seed (default 1)\n"
+                  << "  --threads <n>             generator threads (default: all CPUs)\n"
+                  << "  --reference <path>        also write the reference as FASTA\n";
+        return 1;
+    }
+
+    std::string output = argv[1];
+    GenomeOptions genomeOpts;
+    ReadOptions readOpts;
+    std::string referencePath;
+    auto endsWith = [&](const std::string& suffix) {
+        return output.size() >= suffix.size() && output.compare(output.size() - suffix.size(), suffix.size(), suffix) == 0;
+    };
+    readOpts.fastq = endsWith(".fq") || endsWith(".fastq");
+
+    for (int i = 2; i < argc; i++) {
+        std::string flag = argv[i];
+        if (i + 1 >= argc) {
+            std::cerr << "Unknown option: " << flag << "\n";
+            return 1;
+        }
+        std::string value = argv[++i];
+        if (flag == "--genome") genomeOpts.length = parseMemorySize(value);
+        else if (flag == "--coverage") readOpts.coverage = std::stod(value);
+        else if (flag == "--read-length") readOpts.readLength = std::stoul(value);
+        else if (flag == "--error-rate") readOpts.errorRate = std::stod(value);
+        else if (flag == "--repeats") genomeOpts.repeatFraction = std::stod(value);
+        else if (flag == "--repeat-length") genomeOpts.repeatLength = parseMemorySize(value);
+        else if (flag == "--repeat-families") genomeOpts.repeatFamilies = std::stoul(value);
+        else if (flag == "--divergence") genomeOpts.repeatDivergence = std::stod(value);
+        else if (flag == "--tandem") genomeOpts.tandemFraction = std::stod(value);
+        else if (flag == "--gc") genomeOpts.gcContent = std::stod(value);
+        else if (flag == "--seed") {
+            genomeOpts.seed = std::stoull(value);
+            readOpts.seed = genomeOpts.seed + 1;
+        }
+        else if (flag == "--threads") TaskPool::setGlobalThreads(std::max(1, std::stoi(value)));
+        else if (flag == "--reference") referencePath = value;
+        else {
+            std::cerr << "Unknown option: " << flag << "\n";
+            return 1;
+        }
+    }
+    if (genomeOpts.length < readOpts.readLength || readOpts.readLength == 0) {
+        std::cerr << "--genome must be at least --read-length\n";
+        return 1;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::string genome = buildGenome(genomeOpts);
+    if (!referencePath.empty()) {
+        AsyncOFStream out(referencePath);
+        writeGenome(genome, out);
+    }
+
+    AsyncOFStream out(output);
+    size_t reads = writeReads(genome, readOpts, out);
+    out.close();
+    if (!out) {
+        std::cerr << "Could not write " << output << "\n";
+        return 1;
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Wrote " << reads << " reads (" << reads * readOpts.readLength << " bases) to " << output
+              << " in " << seconds << " s\n";
+    return 0;
+}
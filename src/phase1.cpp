@@ -3,95 +3,15 @@
 #include <vector>
 #include <string>
 #include "phase1.h"
+#include "ThreadPool.h"
+#include "data_structs.h"
+#include "FastReader.h"
 
 #include <queue>
 #include <mutex>
 #include <condition_variable>
 
 
-
-// phase 2 first part converting to kmer blocks
-
-struct KmerBlock {
-    std::vector<std::string> kmers;
-
-    // block for given expected kmers
-    KmerBlock(size_t expectedKmers) {
-        kmers.reserve(expectedKmers);
-    }
-
-    // Default block (empty, no reserve)
-    KmerBlock() = default;
-};
-
-
-// A "bundle" is just a block of raw bytes
-struct FastBundle {
-    std::vector<char> data;
-    bool finalized = false;
-
-    FastBundle(size_t size) { data.reserve(size); }
-
-    void addBlock(const char* buf, size_t n) {
-        data.insert(data.end(), buf, buf + n);
-    }
-
-    void finalize() { finalized = true; }
-};
-
-// Super simple version: just read 1 file into bundles
-class FastReader {
-    std::string path;
-    size_t blockSize;
-
-public:
-    FastReader(std::string p, size_t bs = 1 << 20)  // default 1MB chunks
-        : path(std::move(p)), blockSize(bs) {}
-
-   std::vector<FastBundle> readFile() {
-        std::ifstream in(path);
-        if (!in) {
-            throw std::runtime_error("Could not open file: " + path);
-        }
-
-        std::vector<FastBundle> bundles;
-        std::string line;
-        std::string seqBuffer;
-        seqBuffer.reserve(blockSize * 2);
-
-        while (std::getline(in, line)) {
-
-            if (line.empty() || line[0] == '>') continue;
-
-            // Add DNA to buffer
-            seqBuffer += line;
-
-            // When buffer exceeds blockSize: push buffer to bundle 
-            while (seqBuffer.size() >= blockSize) {
-                FastBundle bundle(blockSize);
-                bundle.addBlock(seqBuffer.data(), blockSize);
-                bundle.finalize();
-                bundles.push_back(std::move(bundle));
-
-                seqBuffer.erase(0, blockSize);
-            }
-        }
-
-        // Push last  bundle
-        if (!seqBuffer.empty()) {
-            FastBundle bundle(seqBuffer.size());
-            bundle.addBlock(seqBuffer.data(), seqBuffer.size());
-            bundle.finalize();
-            bundles.push_back(std::move(bundle));
-        }
-
-        return bundles;
-    }
-
-
-};
-
-
 std::vector<std::string> generateKmers(const std::string &seq, int k) {
     std::vector<std::string> kmers;
     if ((int)seq.size() < k) return kmers;  // too short
@@ -310,51 +230,42 @@ int main() {
 
     const size_t n_size = superMers.size();
 
-    // Spawn worker threads
-    std::vector<std::thread> workers;
-    workers.reserve(NUM_THREADS);
-
-    for (unsigned thr = 0; thr < NUM_THREADS; ++thr) {
-        // each worker
-        workers.emplace_back([&, thr]() {
+    // One task per range on the shared pool
+    TaskPool::global().parallelFor(NUM_THREADS, [&](size_t thr) {
 
-            size_t startIndex = thr * CHUNK;
-            size_t endIndex   = std::min(startIndex + CHUNK, n_size);
+        size_t startIndex = thr * CHUNK;
+        size_t endIndex   = std::min(startIndex + CHUNK, n_size);
 
-            // what ur trynna add to
+        // what ur trynna add to
 
-            auto& myOutput = localBlocks[thr];
-            
-            // Estimated number of kmers for this block.
-            size_t numSuperMers = std::max<size_t>(1, endIndex - startIndex);
-            size_t reserveSize = numSuperMers / 4 + 4;  // heuristic expansion estimate
+        auto& myOutput = localBlocks[thr];
+        
+        // Estimated number of kmers for this block.
+        size_t numSuperMers = std::max<size_t>(1, endIndex - startIndex);
+        size_t reserveSize = numSuperMers / 4 + 4;  // heuristic expansion estimate
 
-            // Reserve
-            myOutput.reserve(reserveSize);
+        // Reserve
+        myOutput.reserve(reserveSize);
 
-            // Loop through assigned portion of superMers
-            for (size_t i = startIndex; i < endIndex; ++i) {
-                const std::string& sm = superMers[i];
+        // Loop through assigned portion of superMers
+        for (size_t i = startIndex; i < endIndex; ++i) {
+            const std::string& sm = superMers[i];
 
-                if (sm.size() < k) continue;
+            if (sm.size() < k) continue;
 
-                size_t numKmers = sm.size()- k + 1;
+            size_t numKmers = sm.size()- k + 1;
 
-                KmerBlock* block = new KmerBlock(numKmers);
-                block->kmers.reserve(numKmers);
+            KmerBlock* block = new KmerBlock(numKmers);
+            block->kmers.reserve(numKmers);
 
-                // Extract kmers from this super-mer
-                for (size_t j = 0; j < numKmers; j++) {
-                    block->kmers.push_back(sm.substr(j, k));
-                }
-
-                myOutput.push_back(block);
+            // Extract kmers from this super-mer
+            for (size_t j = 0; j < numKmers; j++) {
+                block->kmers.push_back(sm.substr(j, k));
             }
-        });
-    }
 
-    // Wait for all threads to finish.
-    for (auto& t : workers) t.join();
+            myOutput.push_back(block);
+        }
+    });
 
     // Merge
     for (auto& vec : localBlocks) {
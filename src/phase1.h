@@ -1,11 +1,17 @@
 #include <string>
 #include <vector>
+#include "MinimizerOrder.h"
 
 std::vector<std::string> generateKmers(const std::string& seq, int k);
 std::string computeMinimizer(const std::string& kmer, int m, int k);
 std::vector<std::string> computeAllMinimizers(const std::string& seq, int m, int k);
 std::vector<std::string> computeSuperMers(const std::string& seq, int m, int k);
 
+// Same as above with a non-default minimizer order (m <= 31 unless lexicographic)
+std::string computeMinimizer(const std::string& kmer, int m, int k, MinimizerOrder order);
+std::vector<std::string> computeAllMinimizers(const std::string& seq, int m, int k, MinimizerOrder order);
+std::vector<std::string> computeSuperMers(const std::string& seq, int m, int k, MinimizerOrder order);
+
 // add the method header for superMerToKmers
 std::vector<std::string> superMerToKmers(const std::string& superMer, int k);
 
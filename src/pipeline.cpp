@@ -3,285 +3,662 @@
 #include <vector>
 #include <string>
 #include <thread>
-#include "phase1.h"
-#include "Hasher.h"
-#include "data_structs.h"
+#include "KmerCounter.h"
+#include "CountFile.h"
+#include "FastReader.h"
+#include "SyntheticGenome.h"
 
-#include <queue>
-#include <mutex>
-#include <condition_variable>
 #include <algorithm>
+#include <functional>
+#include <memory>
+#include <type_traits>
+#include <sys/resource.h>
+
+
+// Largest synthetic genome; bigger inputs cover it more deeply instead
+const size_t MAX_SYNTHETIC_GENOME = size_t(1) << 30;
+
+// Reads totalling about `bases` bases at 10x coverage of a synthetic genome
+// (SyntheticGenome.h), made in memory as they are needed rather than
+// written to disk and read back. There is a job per chunk of reads, so the
+// reader threads generate in parallel; bundles hold whole reads and need
+// no overlap.
+std::vector<BundleJob> syntheticJobs(size_t bases, size_t bundleSize) {
+    GenomeOptions genomeOpts;
+    ReadOptions readOpts;
+    genomeOpts.length = std::min(std::max<size_t>(bases / readOpts.coverage, readOpts.readLength * 10),
+                                 MAX_SYNTHETIC_GENOME);
+    genomeOpts.seed = 12345;
+    readOpts.coverage = std::max<double>(readOpts.coverage, (double)bases / genomeOpts.length);
+    readOpts.seed = genomeOpts.seed + 1;
+    auto genome = std::make_shared<const std::string>(buildGenome(genomeOpts));
+
+    std::vector<BundleJob> jobs;
+    for (size_t chunk = 0; chunk < numReadChunks(*genome, readOpts); chunk++) {
+        jobs.push_back([=](const BundleEmitter& emit) {
+            FastBundle bundle(bundleSize);
+            bool stopped = false;
+            sampleReadChunk(*genome, readOpts, chunk, [&](size_t, const std::string& read, const std::string&) {
+                if (stopped) return;
+                if (!bundle.data.empty() && bundle.data.size() + read.size() + 1 > bundleSize) {
+                    bundle.finalize();
+                    stopped = !emit(bundle);
+                    bundle = FastBundle(bundleSize);
+                }
+                bundle.addBlock(read.data(), read.size());
+                bundle.data.push_back(RECORD_SEPARATOR);
+            });
+            if (!stopped && !bundle.data.empty()) {
+                bundle.finalize();
+                emit(bundle);
+            }
+        });
+    }
+    return jobs;
+}
 
+// "count\tk-mers" for every count that occurs; the last line (count
+// maxCount) includes everything above it. Returns the distinct k-mers.
+size_t writeHistogram(const std::string& path, const std::vector<uint64_t>& histogram) {
+    std::ofstream out(path);
+    size_t distinct = 0;
+    for (size_t c = 1; c < histogram.size(); c++) {
+        if (histogram[c] == 0) continue;
+        out << c << "\t" << histogram[c] << "\n";
+        distinct += histogram[c];
+    }
+    return distinct;
+}
 
+// "kmer\tcount" best first; with Space-Saving counts a third column holds
+// the most each count can overestimate by
+template <typename Traits>
+void writeTop(const std::string& path, const std::vector<TopEntry<typename Traits::Key>>& top,
+              bool withError) {
+    std::ofstream out(path);
+    for (const auto& e : top) {
+        out << Traits::toString(e.key) << "\t" << e.count;
+        if (withError) out << "\t" << e.error;
+        out << "\n";
+    }
+}
 
-// Super simple version: just read 1 file into bundles
-class FastReader {
-    std::string path;
-    size_t blockSize;
-
-public:
-    FastReader(std::string p, size_t bs = 1 << 20)  // default 1MB chunks
-        : path(std::move(p)), blockSize(bs) {}
-
-   std::vector<FastBundle> readFile() {
-        std::ifstream in(path);
-        if (!in) {
-            throw std::runtime_error("Could not open file: " + path);
-        }
+// Counts of the k-mers listed in queryPath (one per line, anything after
+// the k-mer ignored) as "kmer\tcount" lines, instead of the full results.
+// Returns the number of queries.
+template <typename Traits>
+size_t writeQueries(BasicKmerCounter<Traits>& counter, const std::string& queryPath,
+                    const std::string& outPath) {
+    std::ifstream in(queryPath);
+    std::vector<std::string> queries;
+    for (std::string line; std::getline(in, line);) {
+        std::string kmer = line.substr(0, line.find_first_of(" \t\r"));
+        if (kmer.empty() || kmer[0] == '>') continue;
+        std::transform(kmer.begin(), kmer.end(), kmer.begin(), ::toupper);
+        queries.push_back(kmer);
+    }
+    std::vector<uint64_t> counts = counter.count(queries);
 
-        std::vector<FastBundle> bundles;
-        std::string line;
-        std::string seqBuffer;
-        seqBuffer.reserve(blockSize * 2);
+    std::ofstream out(outPath);
+    for (size_t i = 0; i < queries.size(); i++) out << queries[i] << "\t" << counts[i] << "\n";
+    return queries.size();
+}
 
-        while (std::getline(in, line)) {
+// Command line: 4 positional arguments, then optional flags
+struct PipelineOptions {
+    std::vector<std::string> inputs;  // paths, "-" for stdin
+    size_t syntheticBases = 0;        // numeric first argument: generated reads, in memory
+    unsigned numReaders = 4;          // input files read in parallel
+    unsigned decompressThreads = 4;   // BGZF inflate threads per input
+    int k = 0;
+    int m = 0;
+    unsigned numThreads = 1;
+    MinimizerOrder order = MinimizerOrder::Lexicographic;
+    bool superMerStats = false;
+    bool staticBuckets = false;
+    size_t maxMemory = 0;  // bytes, 0 = unlimited
+    bool spill = false;    // flush full tables to sorted runs on disk
+    std::string tmpDir;    // where runs go, default $TMPDIR
+    bool compressed = false;  // output.kcb instead of output.txt
+    std::string updatePath;   // output.kcb adds to the counts of this file
+    bool histogram = false;   // histogram.txt only
+    size_t topN = 0;          // top.txt only, with the N most frequent k-mers
+    bool topSketch = false;   // one-pass approximate top-N
+    size_t bloomBytes = 0;    // Bloom filter pre-pass, 0 = off
+    double epsilon = 0;       // count-min sketch instead of tables, 0 = exact
+    double delta = 0.01;
+    std::string queryPath;    // only write counts of these k-mers
+    CountEngine engine = CountEngine::Hash;
+    bool numa = false;       // pin workers, spread over NUMA nodes
+    bool hugePages = false;  // transparent huge pages for the tables
+    bool taskPool = true;    // stages share a work-stealing pool (else one thread per worker)
+    bool stats = false;      // write stats.json
+    bool perf = false;       // hardware counters in stats.json
+};
 
-            if (line.empty() || line[0] == '>') continue;
+// --stats: per-stage times and rates, queue waits and per-worker table
+// counters as JSON
+template <typename Traits>
+void writeStats(const std::string& path, const PipelineOptions& opts, BasicKmerCounter<Traits>& counter,
+                size_t records) {
+    const CounterStages& stages = counter.stages();
+    const BasicHasher<Traits>& hasher = counter.hasher();
+    MemoryBudget& budget = counter.memory();
+    std::ofstream file(path);
+    JsonWriter json(file);
+    json.field("k", opts.k);
+    json.field("m", opts.m);
+    json.field("threads", opts.numThreads);
+    json.field("scheduler", opts.taskPool && !opts.numa ? "pool" : "threads");
+    json.field("records", records);
+    if (opts.perf) {
+        std::vector<std::string> missing;
+        for (int e = 0; e < NUM_PERF_EVENTS; e++) {
+            if (!PerfCounters::thread().available(e)) missing.push_back(perfEventName(e));
+        }
+        json.array("perf_unavailable", missing);
+    }
 
-            // Add DNA to buffer
-            seqBuffer += line;
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    json.beginObject("total");
+    json.field("wall_s", (wallNs() - stages.startWall) / 1e9);
+    json.field("cpu_s", (processCpuNs() - stages.startCpu) / 1e9);
+    json.field("max_rss_mb", usage.ru_maxrss / 1024);
+    json.endObject();
+
+    json.beginObject("stages");
+    json.stage("read", stages.read);
+    json.stage("supermers", stages.superMers);
+    json.stage("route", stages.route);
+    json.stage("hash", hasher.hashStage());
+    json.stage("finish", stages.finish);
+    json.stage("merge", stages.merge);
+    json.stage("output", stages.output);
+    json.endObject();
+
+    const auto& workers = hasher.getWorkerStats();
+    json.beginObject("queue");
+    json.field("submit_wait_s", hasher.getSubmitWaitNs() / 1e9);
+    std::vector<double> idle;
+    for (const auto& w : workers) idle.push_back(w.idleNs / 1e9);
+    json.array("worker_idle_s", idle);
+    json.endObject();
+
+    json.beginObject("workers");
+    for (size_t t = 0; t < workers.size(); t++) {
+        const auto& w = workers[t];
+        const auto& table = hasher.threadTables[t];
+        json.beginObject(std::to_string(t));
+        json.field("blocks", w.blocks);
+        json.field("kmers", w.kmers);
+        json.field("busy_s", w.busyNs / 1e9);
+        json.field("cpu_s", w.cpuNs / 1e9);
+        json.field("table_flushes", w.tableFlushes);
+        json.field("overflow", w.overflowed);
+        // probes[i]: inserts that found their slot after i collisions
+        std::vector<uint64_t> probes(table.probeHistogram().begin(), table.probeHistogram().end() - 1);
+        while (!probes.empty() && probes.back() == 0) probes.pop_back();
+        json.array("probes", probes);
+        json.field("failed_inserts", table.failedInserts());
+        if (opts.perf) json.perf("perf", w.perf, w.kmers);
+        json.endObject();
+    }
+    json.endObject();
 
-            // When buffer exceeds blockSize: push buffer to bundle 
-            while (seqBuffer.size() >= blockSize) {
-                FastBundle bundle(blockSize);
-                bundle.addBlock(seqBuffer.data(), blockSize);
-                bundle.finalize();
-                bundles.push_back(std::move(bundle));
+    json.beginObject("memory_peak_mb");
+    for (int i = 0; i < (int)MemStage::NumStages; i++) {
+        json.field(memStageName((MemStage)i), budget.peak((MemStage)i) >> 20);
+    }
+    json.endObject();
+    json.field("spilled_records", hasher.getSpilledRecords());
+    json.close();
+}
 
-                seqBuffer.erase(0, blockSize);
+// A KmerCounter fed from the inputs, then one kind of output. Throws on
+// unreadable or corrupt input.
+template <typename Traits>
+int countAndWrite(const PipelineOptions& opts) {
+    const size_t HISTOGRAM_MAX = 10000;
+    const size_t SKETCH_COUNTERS_PER_TOP = 64;
+
+    CounterConfig config;
+    config.k = opts.k;
+    config.m = opts.m;
+    config.threads = opts.numThreads;
+    config.order = opts.order;
+    config.staticBuckets = opts.staticBuckets;
+    config.maxMemory = opts.maxMemory;
+    // Every reader holds a bundle and has one queued
+    size_t numInputs = opts.inputs.size() + (opts.syntheticBases ? opts.numReaders : 0);
+    config.inputBuffers = std::max(1u, std::min<unsigned>(opts.numReaders, numInputs));
+    config.spill = opts.spill;
+    config.tmpDir = opts.tmpDir;
+    config.bloomBytes = opts.bloomBytes;
+    config.epsilon = opts.epsilon;
+    config.delta = opts.delta;
+    if (opts.topSketch) config.topSketch = std::max<size_t>(1024, opts.topN * SKETCH_COUNTERS_PER_TOP);
+    config.engine = opts.engine;
+    config.numa = opts.numa;
+    config.hugePages = opts.hugePages;
+    config.taskPool = opts.taskPool;
+    config.superMerStats = opts.superMerStats;
+    config.log = &std::cout;
+    BasicKmerCounter<Traits> counter(config);
+    CounterStages& stages = counter.stages();
+
+    // Read, compute super-mers and route them, one bundle at a time
+    std::cout << "Reading input and computing super-mers (" << minimizerOrderName(opts.order)
+              << " minimizers)...\n";
+    size_t bundleSize = counter.bundleSize();
+    std::vector<BundleJob> inputs = fileJobs(opts.inputs, bundleSize, opts.k - 1, opts.decompressThreads);
+    if (opts.syntheticBases) {
+        std::vector<BundleJob> synthetic = syntheticJobs(opts.syntheticBases, bundleSize);
+        inputs.insert(inputs.end(), synthetic.begin(), synthetic.end());
+    }
+    ParallelReader reader(std::move(inputs), opts.numReaders);
+    if (opts.syntheticBases) {
+        std::cout << "Generating reads in memory on " << reader.numReaders() << " threads\n";
+    } else if (opts.inputs.size() > 1) {
+        std::cout << opts.inputs.size() << " inputs, " << reader.numReaders() << " readers\n";
+    }
+    counter.add(reader);
+    counter.finish();
+
+    auto finishStats = [&](size_t records) {
+        if (!opts.stats) return;
+        if (opts.perf) {
+            bool any = false;
+            for (int e = 0; e < NUM_PERF_EVENTS; e++) any |= PerfCounters::thread().available(e);
+            if (!any) {
+                std::cout << "Hardware counters unavailable (perf_event_open failed; see perf_event_paranoid)\n";
+            } else {
+                std::cout << "Hardware counters:\n";
+                printPerf(std::cout, "supermers", stages.superMers);
+                printPerf(std::cout, "route", stages.route);
+                printPerf(std::cout, "hash", counter.hasher().hashStage());
             }
         }
-
-        // Push last  bundle
-        if (!seqBuffer.empty()) {
-            FastBundle bundle(seqBuffer.size());
-            bundle.addBlock(seqBuffer.data(), seqBuffer.size());
-            bundle.finalize();
-            bundles.push_back(std::move(bundle));
+        writeStats("stats.json", opts, counter, records);
+        std::cout << "Stats written to stats.json\n";
+    };
+
+    if (opts.histogram) {
+        // Only the abundance histogram; no results map, no output.txt
+        std::cout << "Computing histogram...\n";
+        std::vector<uint64_t> histogram = counter.histogram(HISTOGRAM_MAX);
+        size_t unique;
+        {
+            StageClock::Scope timer(stages.output);
+            unique = writeHistogram("histogram.txt", histogram);
         }
-
-        return bundles;
+        counter.memory().printReport(std::cout);
+        std::cout << "Histogram written to histogram.txt\n";
+        std::cout << "Total unique k-mers: " << unique << "\n";
+        finishStats(unique);
+        std::cout << "Processing complete!\n";
+        return 0;
     }
-};
-
 
-std::vector<std::string> generateKmers(const std::string &seq, int k) {
-    std::vector<std::string> kmers;
-    if ((int)seq.size() < k) return kmers;  // too short
-
-    for (size_t i = 0; i <= seq.size() - k; i++) {
-        kmers.push_back(seq.substr(i, k));
+    if (!opts.queryPath.empty()) {
+        std::cout << "Looking up k-mers from " << opts.queryPath << "...\n";
+        size_t queries = writeQueries(counter, opts.queryPath, "query.txt");
+        if (counter.approximate()) {
+            std::cout << "Counts overestimate by at most " << counter.hasher().getApproximate()->errorBound()
+                      << " with probability " << 1 - opts.delta << "\n";
+        }
+        counter.memory().printReport(std::cout);
+        std::cout << queries << " counts written to query.txt\n";
+        finishStats(queries);
+        std::cout << "Processing complete!\n";
+        return 0;
     }
-    return kmers;
-}
 
-std::string computeMinimizer(const std::string &seq, int m, int k) {
-    std::string minimizer = seq.substr(0, m);
-    for (size_t i = 1; i < seq.size() - m + 1; i++) {
-        std::string current_mmer = seq.substr(i, m);
-        if (current_mmer < minimizer) {
-            minimizer = current_mmer;
+    if (opts.topN > 0) {
+        // Only the heaviest k-mers; no results map unless tables overlap
+        std::cout << "Finding top " << opts.topN << " k-mers"
+                  << (opts.topSketch ? " (Space-Saving)" : "") << "...\n";
+        std::vector<TopEntry<typename Traits::Key>> top = counter.top(opts.topN);
+        {
+            StageClock::Scope timer(stages.output);
+            writeTop<Traits>("top.txt", top, opts.topSketch);
         }
+        counter.memory().printReport(std::cout);
+        std::cout << "Top k-mers written to top.txt\n";
+        finishStats(top.size());
+        std::cout << "Processing complete!\n";
+        return 0;
     }
-    return minimizer;
-}
 
-std::vector<std::string> computeAllMinimizers(const std::string &seq, int m, int k) {
-    auto kmers = generateKmers(seq, k);
-    std::vector<std::string> minimizers(kmers.size());
+    // Merge to table
+    std::cout << "Merging results...\n";
+    counter.merge();
 
-    for (size_t i = 0; i < kmers.size(); i++) {
-        minimizers[i] = computeMinimizer(kmers[i], m, k);
+    const BasicHasher<Traits>& hasher = counter.hasher();
+    if (hasher.getSpilledRuns() > 0) {
+        std::cout << "Spilled " << hasher.getSpilledRuns() << " runs ("
+                  << hasher.getSpilledRecords() << " records) to disk\n";
     }
+    counter.memory().printReport(std::cout);
 
-    return minimizers;
-}
-
-std::vector<std::string> computeSuperMers(const std::string &seq, int m, int k) {
-    auto kmers = generateKmers(seq, k);
-    auto minimizers = computeAllMinimizers(seq, m, k);
-
-    std::vector<std::string> superMers;
-    std::string curSuperMer = "";
-    std::string curMinimizer = "";
-
-    for(size_t i = 0; i < kmers.size(); i++) {
-        if(i == 0) {
-            curSuperMer = kmers[i];
-            curMinimizer = minimizers[i];
-            continue;
-        }
-        if (minimizers[i] == curMinimizer) {
-            curSuperMer += kmers[i].back();
-        } else {
-            superMers.push_back(curSuperMer);
-            curSuperMer = kmers[i];
-            curMinimizer = minimizers[i];
-        }
+    // In spill mode the unique count is only known once the runs are merged
+    std::string outputPath = opts.compressed ? "output.kcb" : "output.txt";
+    if (!opts.updatePath.empty()) {
+        std::cout << "Writing results with the counts of " << opts.updatePath << " to " << outputPath << "...\n";
+    } else {
+        std::cout << "Writing results to " << outputPath << "...\n";
     }
-    superMers.push_back(curSuperMer);
-    return superMers;
-}
+    size_t unique = opts.compressed ? counter.writeCompressed(outputPath, opts.updatePath)
+                                    : counter.writeText(outputPath);
+    std::cout << "Total unique k-mers: " << unique << "\n";
+    finishStats(unique);
 
-std::vector<std::string> superMerToKmers(const std::string& superMer, int k) {
-    std::vector<std::string> kmers;
+    std::cout << "Processing complete!\n";
+    return 0;
+}
 
-    if (superMer.size() < (size_t)k) return kmers;
+// Everything after option parsing, for one k-mer representation
+template <typename Traits>
+int runPipeline(const PipelineOptions& opts) {
+    PerfCounters::enabled() = opts.perf;
 
-    kmers.reserve(superMer.size() - k + 1);
-    for (size_t i = 0; i <= superMer.size() - k; i++) {
-        kmers.push_back(superMer.substr(i, k));
+    if (opts.compressed && !Traits::packed) {
+        std::cerr << (opts.updatePath.empty() ? "--format compressed" : "--update") << " needs k in {";
+#define PRINT_K(K) << " " #K
+        std::cerr KMER_SPECIALIZATIONS(PRINT_K) << " } and m <= 31\n";
+#undef PRINT_K
+        return 1;
     }
-    return kmers;
-}
 
-void pushSuperMersToQueue(const std::vector<std::string>& superMers, int k,
-                           std::queue<KmerBlock*>& inputQueue,
-                           std::mutex& queueLock,
-                           std::condition_variable& cv) {
-    std::vector<KmerBlock*> localBatch;
-    // could be 100::: MAKE SURE TO CHANGE FOR BIG***
-    localBatch.reserve(10);
-
-    for(const auto& superMer: superMers) {
-        auto kmers = superMerToKmers(superMer, k);
-        KmerBlock* block = new KmerBlock(kmers.size());
-        for(const auto& kmer: kmers) {
-            block->kmers.push_back(kmer);
-        }
-        localBatch.push_back(block);
-        
-        // Here too
-        if (localBatch.size() >= 10) {
-            {
-                std::lock_guard<std::mutex> lock(queueLock);
-                for(auto b: localBatch) {
-                    inputQueue.push(b);
-                }
+    if constexpr (Traits::packed) {
+        // A base file of another k would only fail after counting
+        if (!opts.updatePath.empty()) {
+            try {
+                CountFileReader<Traits> base(opts.updatePath);
+                std::cout << "Updating " << opts.updatePath << ": " << base.size() << " k-mers in "
+                          << base.numBlocks() << " blocks\n";
+            } catch (const std::exception& e) {
+                std::cerr << e.what() << "\n";
+                return 1;
             }
-            cv.notify_all();
-            localBatch.clear();
         }
     }
-    
-    if (!localBatch.empty()) {
-        {
-            std::lock_guard<std::mutex> lock(queueLock);
-            for(auto b: localBatch) {
-                inputQueue.push(b);     
-            }
-        }
-        cv.notify_all();    
+
+    try {
+        return countAndWrite<Traits>(opts);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << "\n";
+        return 1;
     }
 }
 
-#include <random>
-
-void generateTestFasta(const std::string& filename, size_t length) {
-    std::ofstream out(filename);
-    const char bases[] = {'A', 'C', 'G', 'T'};
-
-    std::mt19937_64 rng(12345);
-    std::uniform_int_distribution<int> dist(0, 3);
-
-    out << ">synthetic\n";
-    for (size_t i = 0; i < length; i++) {
-        out << bases[dist(rng)];
+// Parses a whole numeric argument. On anything else prints which argument
+// was wrong and returns false.
+template <typename T>
+bool parseNumber(const std::string& name, const std::string& text, T& out) {
+    try {
+        size_t pos = 0;
+        if constexpr (std::is_floating_point_v<T>) out = std::stod(text, &pos);
+        else if constexpr (std::is_unsigned_v<T>) out = (T)std::stoull(text, &pos);
+        else out = (T)std::stoll(text, &pos);
+        if (pos == text.size()) return true;
+    } catch (const std::exception&) {
     }
-    out << "\n";
+    std::cerr << "Invalid value for " << name << ": " << text << "\n";
+    return false;
 }
+
 int main(int argc, char** argv) {
-    if (argc < 5 || argc > 6) {
+    if (argc < 5) {
         std::cout << "Usage:\n"
-                  << "  Option A (generate FASTA): \n"
-                  << "      ./pipeline <fasta_size> <k> <m> <numThreads>\n\n"
+                  << "  Option A (synthetic reads, generated in memory): \n"
+                  << "      ./pipeline <fasta_size> <k> <m> <numThreads> [options]\n\n"
                   << "  Option B (use existing file):\n"
-                  << "      ./pipeline <filepath> <k> <m> <numThreads>\n";
+                  << "      ./pipeline <filepath> <k> <m> <numThreads> [options]\n"
+                  << "      <filepath> may be a comma-separated list of files and globs\n"
+                  << "      (quote them), and - reads from stdin\n\n"
+                  << "  Options:\n"
+                  << "      --order <lex|random|signature>   minimizer order (default lex)\n"
+                  << "      --supermer-stats                 report super-mer length and bucket sizes\n"
+                  << "      --static-buckets                 keep the initial bucket->thread mapping\n"
+                  << "      --max-memory <size>              memory budget, e.g. 512M or 8G (implies --spill)\n"
+                  << "      --spill                          flush full hash tables to sorted runs on disk\n"
+                  << "      --tmp-dir <dir>                  directory for spilled runs (default $TMPDIR)\n"
+                  << "      --input <paths>                  more input files, globs or - (repeatable)\n"
+                  << "      --readers <n>                    input files read, or synthetic reads generated, in parallel (default 4)\n"
+                  << "      --decompress-threads <n>         threads inflating each BGZF input (default 4)\n"
+                  << "      --io <auto|uring|threads>        async file I/O backend (default auto)\n"
+                  << "      --format <text|compressed>       output.txt, or block-compressed output.kcb\n"
+                  << "      --update <file.kcb>              add the counts of an earlier output.kcb (implies --format compressed)\n"
+                  << "      --histogram                      only write the k-mer abundance histogram\n"
+                  << "      --top <n>                        only write the n most frequent k-mers\n"
+                  << "      --top-sketch                     find them in one pass with Space-Saving (approximate)\n"
+                  << "      --bloom <size>                   Bloom filter pre-pass, e.g. 1G: skip k-mers seen once\n"
+                  << "      --query <file>                   only write counts of the k-mers listed in file\n"
+                  << "      --approximate <epsilon>          count-min sketch instead of tables (needs --query)\n"
+                  << "      --approximate-delta <delta>      probability the epsilon bound fails (default 0.01)\n"
+                  << "      --engine <hash|sort|auto>        count with hash tables, by sorting, or per partition\n"
+                  << "      --numa                           pin workers to CPUs spread over NUMA nodes\n"
+                  << "      --huge-pages                     back hash tables with transparent huge pages\n"
+                  << "      --scheduler <pool|threads>       work-stealing task pool (default) or a thread per worker\n"
+                  << "      --stats                          write per-stage timings and table counters to stats.json\n"
+                  << "      --perf                           add hardware counters (IPC, cache/TLB/branch misses) to --stats\n";
         return 1;
     }
 
     std::string inputArg = argv[1];
     bool isNumber = std::all_of(inputArg.begin(), inputArg.end(), ::isdigit);
 
-    size_t fastaSize = 0;
-    std::string fastaPath;
+    PipelineOptions opts;
 
     // bruh why
     if (isNumber) {
-        fastaSize = std::stoull(inputArg);
-        fastaPath = "generated.fasta";
+        if (!parseNumber("<fasta_size>", inputArg, opts.syntheticBases)) return 1;
     } else {
-        fastaPath = inputArg;
+        opts.inputs = expandInputs(inputArg);
     }
 
-    int k = std::stoi(argv[2]);
-    int m = std::stoi(argv[3]);
-    unsigned NUM_THREADS = std::stoi(argv[4]);
-
-    const size_t HASH_TABLE_SIZE = 10'000'000;
-    const size_t MAX_PROBE_STEPS = 100;
-
-    // check to make sure its a number
-    if (isNumber) {
-        std::cout << "Generating FASTA of length " << fastaSize << "...\n";
-        generateTestFasta(fastaPath, fastaSize);
-    } else {
-        std::cout << "Using existing FASTA file: " << fastaPath << "\n";
+    int numThreads;
+    if (!parseNumber("<k>", argv[2], opts.k) || !parseNumber("<m>", argv[3], opts.m) ||
+        !parseNumber("<numThreads>", argv[4], numThreads)) {
+        return 1;
     }
-
-    // Read
-    std::cout << "Reading FASTA bundles...\n";
-    FastReader reader(fastaPath);
-    auto bundles = reader.readFile();
-    std::cout << "Read " << bundles.size() << " bundles\n";
-
-    // Calc SUperMErs
-    std::cout << "Computing super-mers...\n";
-    std::vector<std::string> superMers;
-    for (auto& b : bundles) {
-        auto partial = computeSuperMers(std::string(b.data.begin(), b.data.end()),m,k);
-        superMers.insert(superMers.end(), partial.begin(), partial.end());
+    opts.numThreads = std::max(0, numThreads);
+    // Every parallel stage shares one pool of numThreads threads
+    TaskPool::setGlobalThreads(opts.numThreads);
+
+    for (int i = 5; i < argc; i++) {
+        std::string flag = argv[i];
+        if (flag == "--order" && i + 1 < argc) {
+            if (!parseMinimizerOrder(argv[++i], opts.order)) {
+                std::cerr << "Unknown minimizer order: " << argv[i] << "\n";
+                return 1;
+            }
+        } else if (flag == "--supermer-stats") {
+            opts.superMerStats = true;
+        } else if (flag == "--static-buckets") {
+            opts.staticBuckets = true;
+        } else if (flag == "--max-memory" && i + 1 < argc) {
+            opts.maxMemory = parseMemorySize(argv[++i]);
+            if (opts.maxMemory == 0) {
+                std::cerr << "Invalid memory size: " << argv[i] << "\n";
+                return 1;
+            }
+            opts.spill = true;
+        } else if (flag == "--spill") {
+            opts.spill = true;
+        } else if (flag == "--tmp-dir" && i + 1 < argc) {
+            opts.tmpDir = argv[++i];
+        } else if (flag == "--input" && i + 1 < argc) {
+            for (const auto& path : expandInputs(argv[++i])) opts.inputs.push_back(path);
+        } else if (flag == "--readers" && i + 1 < argc) {
+            int readers;
+            if (!parseNumber(flag, argv[++i], readers)) return 1;
+            opts.numReaders = std::max(1, readers);
+        } else if (flag == "--io" && i + 1 < argc) {
+            std::string io = argv[++i];
+            if (io == "auto") AsyncIO::backend() = AsyncIO::Backend::Auto;
+            else if (io == "uring") AsyncIO::backend() = AsyncIO::Backend::Uring;
+            else if (io == "threads") AsyncIO::backend() = AsyncIO::Backend::Threads;
+            else {
+                std::cerr << "Unknown I/O backend: " << io << "\n";
+                return 1;
+            }
+        } else if (flag == "--histogram") {
+            opts.histogram = true;
+        } else if (flag == "--top" && i + 1 < argc) {
+            long long topN;
+            if (!parseNumber(flag, argv[++i], topN)) return 1;
+            opts.topN = std::max(1LL, topN);
+        } else if (flag == "--bloom" && i + 1 < argc) {
+            opts.bloomBytes = parseMemorySize(argv[++i]);
+            if (opts.bloomBytes == 0) {
+                std::cerr << "Invalid memory size: " << argv[i] << "\n";
+                return 1;
+            }
+        } else if (flag == "--query" && i + 1 < argc) {
+            opts.queryPath = argv[++i];
+        } else if (flag == "--approximate" && i + 1 < argc) {
+            if (!parseNumber(flag, argv[++i], opts.epsilon)) return 1;
+        } else if (flag == "--approximate-delta" && i + 1 < argc) {
+            if (!parseNumber(flag, argv[++i], opts.delta)) return 1;
+        } else if (flag == "--engine" && i + 1 < argc) {
+            std::string engine = argv[++i];
+            if (engine == "hash") opts.engine = CountEngine::Hash;
+            else if (engine == "sort") opts.engine = CountEngine::Sort;
+            else if (engine == "auto") opts.engine = CountEngine::Auto;
+            else {
+                std::cerr << "Unknown counting engine: " << engine << "\n";
+                return 1;
+            }
+        } else if (flag == "--numa") {
+            opts.numa = true;
+        } else if (flag == "--scheduler" && i + 1 < argc) {
+            std::string scheduler = argv[++i];
+            if (scheduler != "pool" && scheduler != "threads") {
+                std::cerr << "Unknown scheduler: " << scheduler << "\n";
+                return 1;
+            }
+            opts.taskPool = scheduler == "pool";
+        } else if (flag == "--stats") {
+            opts.stats = true;
+        } else if (flag == "--perf") {
+            opts.stats = opts.perf = true;
+        } else if (flag == "--huge-pages") {
+            opts.hugePages = true;
+        } else if (flag == "--top-sketch") {
+            opts.topSketch = true;
+        } else if (flag == "--format" && i + 1 < argc) {
+            std::string format = argv[++i];
+            if (format != "text" && format != "compressed") {
+                std::cerr << "Unknown output format: " << format << "\n";
+                return 1;
+            }
+            opts.compressed = format == "compressed";
+        } else if (flag == "--update" && i + 1 < argc) {
+            opts.updatePath = argv[++i];
+        } else if (flag == "--decompress-threads" && i + 1 < argc) {
+            int threads;
+            if (!parseNumber(flag, argv[++i], threads)) return 1;
+            opts.decompressThreads = std::max(1, threads);
+        } else {
+            std::cerr << "Unknown option: " << flag << "\n";
+            return 1;
+        }
     }
-    std::cout << "Total super-mers: " << superMers.size() << "\n";
-
-    // Q + Hasher
-    std::queue<KmerBlock*> inputQueue;
-    std::mutex queueLock;
-    std::condition_variable cv;
 
-    std::cout << "Initializing Hasher...\n";
-    Hasher hasher(inputQueue, NUM_THREADS, HASH_TABLE_SIZE, MAX_PROBE_STEPS);
-
-    std::vector<std::thread> threads;
-
-    std::cout << "Launching " << NUM_THREADS << " worker threads...\n";
-    for (unsigned i = 0; i < NUM_THREADS; i++) {
-        threads.emplace_back(&Hasher::worker, &hasher, i);
+    if (opts.epsilon < 0 || opts.epsilon >= 1 || opts.delta <= 0 || opts.delta >= 1) {
+        std::cerr << "--approximate and --approximate-delta take values between 0 and 1\n";
+        return 1;
+    }
+    if (opts.epsilon > 0 && (opts.queryPath.empty() || opts.bloomBytes > 0 || opts.topN > 0 || opts.histogram)) {
+        std::cerr << "--approximate needs --query and can't be combined with --bloom, --top or --histogram\n";
+        return 1;
+    }
+    if (!opts.updatePath.empty()) {
+        if (opts.histogram || opts.topN > 0 || !opts.queryPath.empty() || opts.bloomBytes > 0) {
+            std::cerr << "--update writes output.kcb; it can't be combined with --histogram, --top, --query or --bloom\n";
+            return 1;
+        }
+        if (!std::ifstream(opts.updatePath)) {
+            std::cerr << "Could not open file: " << opts.updatePath << "\n";
+            return 1;
+        }
+        opts.compressed = true;
+    }
+    if (!opts.queryPath.empty() && !std::ifstream(opts.queryPath)) {
+        std::cerr << "Could not open file: " << opts.queryPath << "\n";
+        return 1;
+    }
+    if (opts.engine != CountEngine::Hash && (opts.epsilon > 0 || opts.bloomBytes > 0 || opts.topSketch)) {
+        std::cerr << "--engine sort|auto can't be combined with --approximate, --bloom or --top-sketch\n";
+        return 1;
+    }
+    if (opts.engine == CountEngine::Auto && opts.staticBuckets) {
+        std::cerr << "--engine auto needs the balancer's sample; drop --static-buckets\n";
+        return 1;
+    }
+    if (opts.maxMemory > 0 && opts.bloomBytes >= opts.maxMemory) {
+        std::cerr << "--bloom must be smaller than --max-memory\n";
+        return 1;
+    }
+    if (opts.topSketch && opts.topN == 0) {
+        std::cerr << "--top-sketch needs --top <n>\n";
+        return 1;
+    }
+    if (opts.inputs.empty() && opts.syntheticBases == 0) {
+        std::cerr << "No input files\n";
+        return 1;
+    }
+    if (std::count(opts.inputs.begin(), opts.inputs.end(), "-") > 1) {
+        std::cerr << "stdin (-) can only be read once\n";
+        return 1;
+    }
+    // Catch missing files before any threads start
+    for (const auto& path : opts.inputs) {
+        if (path != "-" && !std::ifstream(path)) {
+            std::cerr << "Could not open file: " << path << "\n";
+            return 1;
+        }
     }
 
-    // Push into qu
-    std::cout << "Pushing super-mers to queue...\n";
-    pushSuperMersToQueue(superMers, k, inputQueue, queueLock, cv);
-
-    std::cout << "Queue size after batching: " << inputQueue.size() << "\n";
-
-    // Telling workers done
-    std::cout << "Signaling completion...\n";
-    hasher.signalComplete();
-
-    std::cout << "Waiting for threads to finish...\n";
-    for (auto& t : threads) t.join();
-
-    // Merge to table
-    std::cout << "Merging results...\n";
-    hasher.mergeResults();
+    if (opts.k <= 0 || opts.m <= 0 || opts.m > opts.k) {
+        std::cerr << "<k> and <m> must be positive, with m <= k\n";
+        return 1;
+    }
+    if (opts.numThreads == 0) {
+        std::cerr << "<numThreads> must be at least 1\n";
+        return 1;
+    }
+    if (opts.order != MinimizerOrder::Lexicographic && opts.m > 31) {
+        std::cerr << "Minimizer order " << minimizerOrderName(opts.order) << " needs m <= 31\n";
+        return 1;
+    }
 
-    const auto& results = hasher.getResults();
-    std::cout << "Total unique k-mers: " << results.size() << "\n";
+    try {
+        std::cout << "File I/O: " << asyncBackendName() << "\n";
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
 
-    std::cout << "Writing results to output.txt...\n";
-    hasher.writeResults("output.txt");
+    // check to make sure its a number
+    if (isNumber) {
+        std::cout << "Counting about " << opts.syntheticBases << " bases of synthetic reads\n";
+    } else if (opts.inputs.size() == 1) {
+        std::cout << "Using existing FASTA file: " << opts.inputs[0] << "\n";
+    } else {
+        std::cout << "Using " << opts.inputs.size() << " input files\n";
+    }
 
-    std::cout << "Processing complete!\n";
-    return 0;
+    // Compile-time specialized engines for common k, generic otherwise
+    if (opts.m > 0 && opts.m <= opts.k && opts.m <= 31) {
+        switch (opts.k) {
+#define DISPATCH_K(K) case K: return runPipeline<PackedKmerTraits<K>>(opts);
+            KMER_SPECIALIZATIONS(DISPATCH_K)
+#undef DISPATCH_K
+            default: break;
+        }
+    }
+    return runPipeline<StringKmerTraits>(opts);
 }
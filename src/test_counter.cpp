@@ -0,0 +1,219 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <random>
+#include <cstdlib>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include "KmerCounter.h"
+
+// KmerCounter as a library: buffers added one at a time, results read
+// back in memory and checked against a std::map
+
+// Reads of 100 bases from a small random genome, so k-mers repeat
+std::vector<std::string> makeReads(size_t numReads, uint64_t seed) {
+    std::mt19937_64 rng(seed);
+    std::string genome(5000, 'A');
+    for (char& c : genome) c = "ACGT"[rng() & 3];
+    std::vector<std::string> reads;
+    for (size_t i = 0; i < numReads; i++) reads.push_back(genome.substr(rng() % (genome.size() - 100), 100));
+    return reads;
+}
+
+std::map<std::string, uint64_t> bruteForce(const std::vector<std::string>& reads, int k) {
+    std::map<std::string, uint64_t> counts;
+    for (const auto& read : reads) {
+        for (size_t i = 0; i + k <= read.size(); i++) counts[read.substr(i, k)]++;
+    }
+    return counts;
+}
+
+// Adds the reads in buffers of 50, then checks count(), forEach(),
+// results() and histogram() (each on its own counter, as histogram()
+// replaces the merged results)
+template <typename Traits>
+bool testCounter(const std::string& name, int k, int m, bool pool) {
+    std::vector<std::string> reads = makeReads(2000, k);
+    std::map<std::string, uint64_t> expected = bruteForce(reads, k);
+
+    CounterConfig config;
+    config.k = k;
+    config.m = m;
+    config.threads = 3;
+    config.taskPool = pool;
+    auto feed = [&](BasicKmerCounter<Traits>& counter) {
+        std::string buffer;
+        for (size_t i = 0; i < reads.size(); i++) {
+            buffer += reads[i];
+            buffer += RECORD_SEPARATOR;
+            if (i % 50 == 49) {
+                counter.add(buffer);
+                buffer.clear();
+            }
+        }
+        counter.add(buffer);
+        counter.finish();
+    };
+
+    BasicKmerCounter<Traits> counter(config);
+    feed(counter);
+    bool ok = true;
+    for (const auto& [kmer, count] : expected) ok &= counter.count(kmer) == count;
+    ok &= counter.count(std::string(k, 'N')) == 0 && counter.count("ACGT") == 0;
+
+    std::map<std::string, uint64_t> streamed;
+    counter.forEach([&](const typename Traits::Key& key, uint64_t count) { streamed[Traits::toString(key)] = count; });
+    ok &= streamed == expected && counter.results().size() == expected.size();
+
+    BasicKmerCounter<Traits> histogramCounter(config);
+    feed(histogramCounter);
+    std::vector<uint64_t> histogram = histogramCounter.histogram(1000);
+    std::vector<uint64_t> expectedHistogram(1001, 0);
+    for (const auto& [kmer, count] : expected) expectedHistogram[std::min<uint64_t>(count, 1000)]++;
+    ok &= histogram == expectedHistogram;
+
+    std::cout << "  " << name << (pool ? ", pool" : ", threads") << ": " << expected.size()
+              << " distinct k-mers " << (ok ? "PASS" : "FAIL") << "\n";
+    return ok;
+}
+
+// Spill mode: counts only exist as a merge of runs, so a list of k-mers
+// is looked up in one pass
+bool testSpilledLookup() {
+    using Traits = PackedKmerTraits<31>;
+    std::vector<std::string> reads = makeReads(3000, 7);
+    std::map<std::string, uint64_t> expected = bruteForce(reads, 31);
+
+    CounterConfig config;
+    config.k = 31;
+    config.m = 15;
+    config.threads = 2;
+    config.maxMemory = 16 << 20;
+    config.spill = true;
+    BasicKmerCounter<Traits> counter(config);
+    for (const auto& read : reads) counter.add(read);
+    counter.finish();
+
+    std::vector<std::string> queries = {"ACGTACGTACGTACGTACGTACGTACGTACG"};
+    for (const auto& [kmer, count] : expected) {
+        if (queries.size() < 500) queries.push_back(kmer);
+    }
+    std::vector<uint64_t> counts = counter.count(queries);
+    bool ok = counts.size() == queries.size();
+    for (size_t i = 0; ok && i < queries.size(); i++) {
+        auto it = expected.find(queries[i]);
+        ok &= counts[i] == (it == expected.end() ? 0 : it->second);
+    }
+    std::cout << "  spill, " << queries.size() << " queries: " << (ok ? "PASS" : "FAIL") << "\n";
+    return ok;
+}
+
+// Misuse is reported, not undefined
+bool testErrors() {
+    bool ok = true;
+    CounterConfig config;
+    config.m = 40;
+    try {
+        BasicKmerCounter<PackedKmerTraits<31>> counter(config);
+        ok = false;
+    } catch (const std::invalid_argument&) {
+    }
+
+    config.m = 15;
+    BasicKmerCounter<PackedKmerTraits<31>> counter(config);
+    try {
+        counter.count("ACGT");
+        ok = false;
+    } catch (const std::logic_error&) {
+    }
+    counter.finish();
+    try {
+        counter.add("ACGT");
+        ok = false;
+    } catch (const std::logic_error&) {
+    }
+    std::cout << "  bad config, early results, late input: " << (ok ? "PASS" : "FAIL") << "\n";
+    return ok;
+}
+
+// One budgeted count in this process: about 10M bases of reads from a 2M
+// base genome, made a buffer at a time, so the tables spill
+void countUnderBudget(unsigned threads, size_t maxMemory) {
+    CounterConfig config;
+    config.threads = threads;
+    config.maxMemory = maxMemory;
+    config.spill = true;
+    TaskPool::setGlobalThreads(threads);
+    BasicKmerCounter<PackedKmerTraits<31>> counter(config);
+
+    std::mt19937_64 rng(99);
+    std::string genome(2000000, 'A');
+    for (char& c : genome) c = "ACGT"[rng() & 3];
+    std::string buffer;
+    for (size_t i = 0; i < 100000; i++) {
+        buffer.append(genome, rng() % (genome.size() - 100), 100);
+        buffer.push_back(RECORD_SEPARATOR);
+        if (buffer.size() >= counter.bundleSize()) {
+            counter.add(std::move(buffer));
+            buffer.clear();
+        }
+    }
+    counter.add(std::move(buffer));
+    counter.finish();
+    counter.forEach([](const auto&, uint64_t) {});
+}
+
+// Max RSS only grows within a process, so every thread count runs in a
+// child (this binary again) whose peak is read back with wait4()
+bool testMemoryBudget(const char* self) {
+    const size_t BUDGET = 48 << 20;
+    bool ok = true;
+    for (unsigned threads : {1u, 4u, 16u, 64u}) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            std::string t = std::to_string(threads), mem = std::to_string(BUDGET);
+            execl(self, self, "--budget-child", t.c_str(), mem.c_str(), (char*)nullptr);
+            _exit(127);
+        }
+        int status = 0;
+        rusage usage{};
+        bool ran = pid > 0 && wait4(pid, &status, 0, &usage) == pid && WIFEXITED(status) &&
+                   WEXITSTATUS(status) == 0;
+        size_t rssMB = usage.ru_maxrss / 1024;
+        // Code, stacks and allocator slack come on top of the budget
+        bool pass = ran && rssMB <= (BUDGET >> 20) * 3 / 2;
+        std::cout << "  " << threads << " threads, budget " << (BUDGET >> 20) << " MB: max RSS " << rssMB
+                  << " MB: " << (pass ? "PASS" : "FAIL") << "\n";
+        ok &= pass;
+    }
+    return ok;
+}
+
+int main(int argc, char** argv) {
+    if (argc == 4 && std::string(argv[1]) == "--budget-child") {
+        countUnderBudget(std::stoul(argv[2]), std::stoull(argv[3]));
+        return 0;
+    }
+    std::cout << "=== KmerCounter Tests ===\n\n";
+    bool ok = true;
+
+    std::cout << "Test 1: Counts, streaming and histogram against a map\n";
+    ok &= testCounter<PackedKmerTraits<31>>("k=31", 31, 15, true);
+    ok &= testCounter<PackedKmerTraits<31>>("k=31", 31, 15, false);
+    ok &= testCounter<PackedKmerTraits<63>>("k=63", 63, 21, true);
+    ok &= testCounter<StringKmerTraits>("k=20 (generic)", 20, 9, true);
+
+    std::cout << "\nTest 2: Lookups in spill mode\n";
+    ok &= testSpilledLookup();
+
+    std::cout << "\nTest 3: Errors\n";
+    ok &= testErrors();
+
+    std::cout << "\nTest 4: Max RSS under --max-memory as threads grow\n";
+    ok &= testMemoryBudget(argv[0]);
+
+    std::cout << "\n=== " << (ok ? "All Tests Passed" : "SOME TESTS FAILED") << " ===\n";
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,231 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <random>
+#include <fstream>
+#include <iterator>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include "Kmer.h"
+#include "CountFile.h"
+#include "CountMerge.h"
+
+template <int K>
+std::vector<std::pair<typename PackedKmerTraits<K>::Key, uint64_t>> randomTable(size_t n) {
+    using Traits = PackedKmerTraits<K>;
+    std::mt19937_64 rng(K);
+    std::vector<std::pair<typename Traits::Key, uint64_t>> table;
+    for (size_t i = 0; i < n; i++) {
+        typename Traits::Key key = rng();
+        if constexpr (K > 31) key = (key << 64) | rng();
+        // Mostly small counts, a few large ones
+        uint64_t count = (i % 1000 == 0) ? rng() : 1 + rng() % 5;
+        table.push_back({key & Traits::MASK, count});
+    }
+    std::sort(table.begin(), table.end());
+    table.erase(std::unique(table.begin(), table.end(),
+                            [](const auto& a, const auto& b) { return a.first == b.first; }),
+                table.end());
+    return table;
+}
+
+std::string fileBytes(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(in), {});
+}
+
+template <int K>
+bool testRoundTrip(size_t n) {
+    using Traits = PackedKmerTraits<K>;
+    auto table = randomTable<K>(n);
+
+    // Streamed and parallel-encoded files must be identical
+    {
+        CountFileWriter<Traits> writer("/tmp/test_countfile_a.kcb", 100);
+        for (const auto& [key, count] : table) writer.add(key, count);
+        writer.close();
+    }
+    {
+        CountFileWriter<Traits> writer("/tmp/test_countfile_b.kcb", 100);
+        writer.addSorted(table.data(), table.size(), 4);
+        writer.close();
+    }
+    bool same = fileBytes("/tmp/test_countfile_a.kcb") == fileBytes("/tmp/test_countfile_b.kcb");
+
+    CountFileReader<Traits> reader("/tmp/test_countfile_a.kcb");
+    std::vector<std::pair<typename Traits::Key, uint64_t>> back;
+    reader.forEach([&](typename Traits::Key key, uint64_t count) { back.push_back({key, count}); });
+    bool roundTrip = back == table && reader.size() == table.size();
+
+    // Decode blocks on several threads
+    std::vector<std::vector<std::pair<typename Traits::Key, uint64_t>>> blocks(reader.numBlocks());
+    std::vector<std::thread> threads;
+    for (unsigned t = 0; t < 4; t++) {
+        threads.emplace_back([&, t]() {
+            for (size_t b = t; b < blocks.size(); b += 4) reader.readBlock(b, blocks[b]);
+        });
+    }
+    for (auto& t : threads) t.join();
+    std::vector<std::pair<typename Traits::Key, uint64_t>> parallel;
+    for (const auto& block : blocks) parallel.insert(parallel.end(), block.begin(), block.end());
+    bool parallelOk = parallel == table;
+
+    bool lookups = true;
+    for (size_t i = 0; i < table.size(); i += 97) {
+        lookups &= reader.lookup(table[i].first) == table[i].second;
+        bool absent = i + 1 == table.size() || table[i + 1].first != table[i].first + 1;
+        if (absent) lookups &= reader.lookup(table[i].first + 1) == 0;
+    }
+
+    size_t bytes = fileBytes("/tmp/test_countfile_a.kcb").size();
+    std::remove("/tmp/test_countfile_a.kcb");
+    std::remove("/tmp/test_countfile_b.kcb");
+
+    bool ok = same && roundTrip && parallelOk && lookups;
+    std::cout << "  k=" << K << ", " << table.size() << " records, "
+              << (table.empty() ? 0.0 : (double)bytes / table.size()) << " bytes/record: "
+              << (ok ? "PASS" : "FAIL") << "\n";
+    return ok;
+}
+
+// New counts for a few k-mers of the base file, k-mers between them and
+// k-mers before and after all of them; only their blocks get decoded
+template <int K>
+bool testUpdate(size_t n) {
+    using Traits = PackedKmerTraits<K>;
+    using Key = typename Traits::Key;
+    auto base = randomTable<K>(n);
+    {
+        CountFileWriter<Traits> writer("/tmp/test_countfile_base.kcb", 100);
+        writer.addSorted(base.data(), base.size(), 4);
+        writer.close();
+    }
+
+    std::map<Key, uint64_t> added;
+    if (!base.empty()) added[0] += 3;
+    for (size_t i = 0; i < base.size(); i += 5000) {
+        added[base[i].first] += 2;
+        if (i + 1 == base.size() || base[i + 1].first != base[i].first + 1) added[base[i].first + 1] += 1;
+    }
+    added[Traits::MASK] += 7;
+    std::map<Key, uint64_t> expected(base.begin(), base.end());
+    for (const auto& [key, count] : added) expected[key] += count;
+
+    CountFileReader<Traits> reader("/tmp/test_countfile_base.kcb");
+    CountFileWriter<Traits> writer("/tmp/test_countfile_update.kcb", 100);
+    CountFileUpdate<Traits> update(reader, writer);
+    for (const auto& [key, count] : added) update.add(key, count);
+    update.finish();
+    writer.close();
+
+    CountFileReader<Traits> updated("/tmp/test_countfile_update.kcb");
+    std::map<Key, uint64_t> back;
+    bool ordered = true;
+    updated.forEach([&](Key key, uint64_t count) {
+        ordered &= back.empty() || back.rbegin()->first < key;
+        back[key] = count;
+    });
+    bool ok = ordered && back == expected && updated.size() == expected.size();
+    for (const auto& [key, count] : added) ok &= updated.lookup(key) == expected[key];
+    // The first and last block hold added k-mers, and one block per 5000 records
+    ok &= update.blocksDecoded() <= 2 + (base.size() + 4999) / 5000;
+
+    std::remove("/tmp/test_countfile_base.kcb");
+    std::remove("/tmp/test_countfile_update.kcb");
+    std::cout << "  k=" << K << ", " << base.size() << " + " << added.size() << " records, "
+              << update.blocksDecoded() << " of " << reader.numBlocks() << " blocks decoded: "
+              << (ok ? "PASS" : "FAIL") << "\n";
+    return ok;
+}
+
+// Three overlapping files merged with every set and count operation,
+// against merging them in a std::map
+bool testMerge() {
+    using Traits = PackedKmerTraits<31>;
+    using Key = Traits::Key;
+    auto table = randomTable<31>(50000);
+    std::vector<std::map<Key, uint64_t>> files(3);
+    std::vector<std::unique_ptr<CountFileReader<Traits>>> readers;
+    std::vector<const CountFileReader<Traits>*> inputs;
+    for (size_t f = 0; f < files.size(); f++) {
+        std::string path = "/tmp/test_countfile_merge" + std::to_string(f) + ".kcb";
+        CountFileWriter<Traits> writer(path, 64 << f);
+        for (size_t i = 0; i < table.size(); i++) {
+            if ((i * 7 + f) % 5 < 2) continue;
+            uint64_t count = 1 + (table[i].second + f) % 4;
+            files[f][table[i].first] = count;
+            writer.add(table[i].first, count);
+        }
+        writer.close();
+        readers.push_back(std::make_unique<CountFileReader<Traits>>(path));
+        inputs.push_back(readers.back().get());
+        std::remove(path.c_str());
+    }
+
+    bool ok = true;
+    for (SetOp set : {SetOp::Union, SetOp::Intersect, SetOp::Difference}) {
+        for (CountOp combine : {CountOp::Sum, CountOp::Min, CountOp::Max}) {
+            MergeOptions opts;
+            opts.set = set;
+            opts.combine = combine;
+            opts.inputMinCount = combine == CountOp::Max ? 2 : 1;
+            opts.minInputs = combine == CountOp::Min && set == SetOp::Union ? 2 : 1;
+            opts.minCount = 2;
+            opts.maxCount = 7;
+
+            std::map<Key, std::vector<std::pair<size_t, uint64_t>>> present;
+            for (size_t f = 0; f < files.size(); f++) {
+                for (const auto& [key, count] : files[f]) {
+                    if (count >= opts.inputMinCount) present[key].push_back({f, count});
+                }
+            }
+            std::vector<std::pair<Key, uint64_t>> expected;
+            for (const auto& [key, in] : present) {
+                if (in.size() < opts.minInputs) continue;
+                if (set == SetOp::Intersect && in.size() != files.size()) continue;
+                if (set == SetOp::Difference && (in.size() != 1 || in[0].first != 0)) continue;
+                uint64_t count = in[0].second;
+                for (size_t i = 1; i < in.size(); i++) {
+                    if (combine == CountOp::Sum) count += in[i].second;
+                    if (combine == CountOp::Min) count = std::min(count, in[i].second);
+                    if (combine == CountOp::Max) count = std::max(count, in[i].second);
+                }
+                if (count >= opts.minCount && count <= opts.maxCount) expected.push_back({key, count});
+            }
+
+            CountMerge<Traits> merge(inputs, opts);
+            std::vector<std::pair<Key, uint64_t>> merged;
+            size_t n = merge.run([&](const std::vector<std::pair<Key, uint64_t>>& records) {
+                merged.insert(merged.end(), records.begin(), records.end());
+            }, 4);
+            ok &= merged == expected && n == expected.size() && !expected.empty();
+        }
+    }
+    std::cout << "  3 files, every operation: " << (ok ? "PASS" : "FAIL") << "\n";
+    return ok;
+}
+
+int main() {
+    std::cout << "=== Count File Tests ===\n\n";
+    bool ok = true;
+
+    std::cout << "Test 1: Write, read back, seek and decode blocks in parallel\n";
+    ok &= testRoundTrip<31>(0);
+    ok &= testRoundTrip<31>(1);
+    ok &= testRoundTrip<21>(100000);
+    ok &= testRoundTrip<51>(100000);
+    ok &= testRoundTrip<63>(12345);
+
+    std::cout << "\nTest 2: Add counts to a file, copying untouched blocks\n";
+    ok &= testUpdate<31>(0);
+    ok &= testUpdate<21>(100000);
+    ok &= testUpdate<63>(54321);
+
+    std::cout << "\nTest 3: Set operations as a k-way merge\n";
+    ok &= testMerge();
+
+    std::cout << "\n=== " << (ok ? "All Tests Passed" : "SOME TESTS FAILED") << " ===\n";
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,144 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <algorithm>
+#include "KmerEngine.h"
+#include "QuadraticHashTable.h"
+
+// Naive minimizer rank of one k-mer
+uint64_t naiveMinimizer(const std::string& kmer, int m, MinimizerOrder order) {
+    uint64_t best = minimizerRank(kmer.data(), m, order);
+    for (size_t i = 1; i + m <= kmer.size(); i++) {
+        best = std::min(best, minimizerRank(kmer.data() + i, m, order));
+    }
+    return best;
+}
+
+std::string randomSeq(size_t length, bool withN) {
+    std::string seq;
+    for (size_t i = 0; i < length; i++) {
+        seq += (withN && rand() % 200 == 0) ? 'N' : "ACGT"[rand() % 4];
+    }
+    return seq;
+}
+
+template <int K>
+bool testSuperMers(int m, bool withN, MinimizerOrder order = MinimizerOrder::Lexicographic) {
+    using Traits = PackedKmerTraits<K>;
+    KmerEngine<Traits> engine(K, m, order);
+    std::string seq = randomSeq(5000, withN);
+
+    // Expected: every k-mer without an N, in order
+    std::vector<typename Traits::Key> expected;
+    for (size_t i = 0; i + K <= seq.size(); i++) {
+        typename Traits::Key key;
+        if (Traits::encode(seq.data() + i, key)) expected.push_back(key);
+    }
+
+    std::vector<typename Traits::Key> got;
+    bool sameMinimizer = true;
+    for (const auto& sm : engine.superMers(seq)) {
+        engine.expand(sm.bases, got);
+        for (size_t i = 0; i + K <= sm.bases.size(); i++) {
+            if (naiveMinimizer(sm.bases.substr(i, K), m, order) != sm.minimizer) sameMinimizer = false;
+        }
+    }
+
+    bool ok = (got == expected) && sameMinimizer;
+    std::cout << "  k=" << K << " m=" << m << " " << minimizerOrderName(order)
+              << (withN ? " (with N)" : "")
+              << ": " << (ok ? "PASS" : "FAIL") << "\n";
+    return ok;
+}
+
+template <int K>
+bool testPackedTable() {
+    using Traits = PackedKmerTraits<K>;
+    BasicQuadraticHashTable<Traits> table(1009, 10);
+    std::string s = randomSeq(K, false);
+    typename Traits::Key key;
+    Traits::encode(s.data(), key);
+
+    for (int i = 0; i < 4; i++) table.insert(key);
+
+    typename BasicQuadraticHashTable<Traits>::Map map;
+    table.exportToMap(map);
+    bool ok = map.size() == 1 && map[key] == 4 && Traits::toString(key) == s;
+    std::cout << "  k=" << K << " packed table: " << (ok ? "PASS" : "FAIL") << "\n";
+    return ok;
+}
+
+bool testSignatureRank() {
+    // AAA/ACA prefixes and inner AA rank after every allowed m-mer
+    uint64_t allowed = minimizerRank("CGTAC", 5, MinimizerOrder::Signature);
+    bool ok = minimizerRank("AAACG", 5, MinimizerOrder::Signature) > allowed &&
+              minimizerRank("ACACG", 5, MinimizerOrder::Signature) > allowed &&
+              minimizerRank("CGAAT", 5, MinimizerOrder::Signature) > allowed &&
+              minimizerRank("AACGT", 5, MinimizerOrder::Signature) < allowed;
+    std::cout << "  signature rank: " << (ok ? "PASS" : "FAIL") << "\n";
+    return ok;
+}
+
+// Soft-masked input: lowercase runs give the same k-mers as uppercase, in
+// the packed and the generic engine alike
+bool testMixedCase() {
+    const int K = 21, M = 11;
+    std::string upper = randomSeq(3000, false);
+    std::string mixed = upper;
+    for (size_t i = 0; i < mixed.size(); i += 50 + rand() % 100) {
+        for (size_t j = i; j < std::min(mixed.size(), i + 1 + rand() % 80); j++) mixed[j] = tolower(mixed[j]);
+    }
+
+    std::vector<std::string> expected;
+    for (size_t i = 0; i + K <= upper.size(); i++) expected.push_back(upper.substr(i, K));
+    std::sort(expected.begin(), expected.end());
+
+    using Packed = PackedKmerTraits<K>;
+    KmerEngine<Packed> packedEngine(K, M);
+    std::vector<Packed::Key> packedKeys;
+    for (const auto& sm : packedEngine.superMers(mixed)) packedEngine.expand(sm.bases, packedKeys);
+    std::vector<std::string> packed;
+    for (auto key : packedKeys) packed.push_back(Packed::toString(key));
+    std::sort(packed.begin(), packed.end());
+
+    KmerEngine<StringKmerTraits> genericEngine(K, M);
+    std::vector<std::string> generic;
+    for (const auto& sm : genericEngine.superMers(mixed)) genericEngine.expand(sm.bases, generic);
+    std::sort(generic.begin(), generic.end());
+
+    std::string lowerKmer = mixed.substr(0, K);
+    for (char& c : lowerKmer) c = tolower(c);
+    bool queries = StringKmerTraits::fromString(lowerKmer) == upper.substr(0, K) &&
+                   Packed::fromString(lowerKmer) == Packed::fromString(upper.substr(0, K));
+
+    bool ok = packed == expected && generic == expected && queries;
+    std::cout << "  k=" << K << " packed and generic: " << (ok ? "PASS" : "FAIL") << "\n";
+    return ok;
+}
+
+int main() {
+    std::cout << "=== KmerEngine Tests ===\n\n";
+    bool ok = true;
+
+    std::cout << "Test 1: Packed super-mers cover every k-mer and share a minimizer\n";
+    ok &= testSuperMers<21>(11, false);
+    ok &= testSuperMers<31>(15, false);
+    ok &= testSuperMers<31>(15, true);
+    ok &= testSuperMers<63>(31, true);
+    ok &= testSuperMers<31>(11, true, MinimizerOrder::Random);
+    ok &= testSuperMers<25>(9, true, MinimizerOrder::Signature);
+
+    std::cout << "\nTest 2: Packed keys round-trip through the hash table\n";
+    ok &= testPackedTable<25>();
+    ok &= testPackedTable<51>();
+
+    std::cout << "\nTest 3: Signature order pushes AA-rich m-mers last\n";
+    ok &= testSignatureRank();
+
+    std::cout << "\nTest 4: Lowercase bases count as uppercase\n";
+    ok &= testMixedCase();
+
+    std::cout << "\n=== " << (ok ? "All Tests Passed" : "SOME TESTS FAILED") << " ===\n";
+    return ok ? 0 : 1;
+}
@@ -125,6 +125,16 @@ int main() {
     std::cout << "  All insertions successful: " << (ins1 && ins2 && ins3 ? "YES" : "NO") << "\n";
     std::cout << "  PASS: " << (ins1 && ins2 && ins3 ? "YES" : "NO") << "\n\n";
     
+    // Test 8: Probe-length histogram accounts for every insert
+    std::cout << "Test 8: Probe-length histogram (table from Test 5)\n";
+    const std::vector<uint64_t>& probes = table5.probeHistogram();
+    uint64_t recorded = 0;
+    for (uint64_t n : probes) recorded += n;
+    std::cout << "  Buckets: " << probes.size() << ", inserts recorded: " << recorded
+              << ", failed: " << table5.failedInserts() << "\n";
+    bool histogramOk = probes.size() == 4 && recorded == 100 && table5.failedInserts() == (uint64_t)failed;
+    std::cout << "  PASS: " << (histogramOk ? "YES" : "NO") << "\n\n";
+    
     std::cout << "=== All Tests Complete ===\n";
     
     return 0;
@@ -5,7 +5,10 @@
 #include <thread>
 #include <chrono>
 #include <unordered_map>
+#include <algorithm>
+#include <random>
 #include "Hasher.h"
+#include "BucketBalancer.h"
 
 // Default hash table parameters
 const size_t DEFAULT_TABLE_SIZE = 1000000;
@@ -202,6 +205,273 @@ void testEmptyQueue() {
     std::cout << "  Empty result: " << (correct ? "YES ✓" : "NO ✗") << "\n";
 }
 
+void testRoutedHasher() {
+    std::cout << "\n=== Test: Routed per-worker queues ===\n";
+    
+    const unsigned numThreads = 4;
+    std::vector<std::string> testKmers = generateTestKmers(5000);
+    
+    Hasher hasher(numThreads, DEFAULT_TABLE_SIZE, DEFAULT_MAX_STEPS);
+    
+    std::vector<std::thread> threads;
+    for (unsigned i = 0; i < numThreads; i++) {
+        threads.push_back(std::thread(&Hasher::worker, &hasher, i));
+    }
+    
+    // Same k-mer always goes to the same worker
+    std::vector<KmerBlock*> blocks(numThreads, nullptr);
+    for (const std::string& kmer : testKmers) {
+        unsigned w = std::hash<std::string>{}(kmer) % numThreads;
+        if (!blocks[w]) blocks[w] = new KmerBlock();
+        blocks[w]->kmers.push_back(kmer);
+        if (blocks[w]->kmers.size() >= 100) {
+            hasher.submit(w, blocks[w]);
+            blocks[w] = nullptr;
+        }
+    }
+    for (unsigned w = 0; w < numThreads; w++) {
+        if (blocks[w]) hasher.submit(w, blocks[w]);
+    }
+    
+    hasher.signalComplete();
+    
+    for (std::thread& t : threads) {
+        t.join();
+    }
+    
+    hasher.mergeResults();
+    bool correct = compareMaps(hasher.getResults(), manualCount(testKmers));
+    std::cout << "  Results match: " << (correct ? "YES ✓" : "NO ✗") << "\n";
+}
+
+// Routed mode with workers as tasks on a pool smaller than the number of
+// workers; spilling tiny tables also exercises the per-worker flush
+void testPooledHasher() {
+    std::cout << "\n=== Test: Workers on a task pool ===\n";
+    
+    const unsigned numWorkers = 4;
+    std::vector<std::string> testKmers = generateTestKmers(20000, 6);
+    TaskPool pool(3);
+    
+    Hasher hasher(numWorkers, 101, 5);
+    hasher.enableTableSpill();
+    hasher.runOn(pool);
+    
+    // Blocks are submitted from pool tasks too
+    pool.parallelFor(numWorkers, [&](size_t part) {
+        std::vector<KmerBlock*> blocks(numWorkers, nullptr);
+        for (size_t i = part; i < testKmers.size(); i += numWorkers) {
+            const std::string& kmer = testKmers[i];
+            unsigned w = std::hash<std::string>{}(kmer) % numWorkers;
+            if (!blocks[w]) blocks[w] = new KmerBlock();
+            blocks[w]->kmers.push_back(kmer);
+            if (blocks[w]->kmers.size() >= 100) {
+                hasher.submit(w, blocks[w]);
+                blocks[w] = nullptr;
+            }
+        }
+        for (unsigned w = 0; w < numWorkers; w++) {
+            if (blocks[w]) hasher.submit(w, blocks[w]);
+        }
+    });
+    
+    hasher.signalComplete();
+    hasher.waitForWorkers();
+    
+    hasher.mergeResults();
+    std::cout << "  Runs spilled: " << hasher.getSpilledRuns() << "\n";
+    
+    std::unordered_map<std::string, size_t> results;
+    hasher.streamResults([&](const std::string& kmer, uint64_t count) { results[kmer] += count; });
+    bool correct = compareMaps(results, manualCount(testKmers));
+    std::cout << "  Results match: " << (correct ? "YES ✓" : "NO ✗") << "\n";
+}
+
+void testTableSpill() {
+    std::cout << "\n=== Test: Table spill to sorted runs ===\n";
+    
+    const unsigned numThreads = 4;
+    // Short k-mers so there are plenty of repeats, tiny tables so they
+    // fill up and get flushed many times
+    std::vector<std::string> testKmers = generateTestKmers(20000, 6);
+    std::queue<KmerBlock*> queue;
+    populateQueue(queue, testKmers, 100);
+    
+    Hasher hasher(queue, numThreads, 101, 5);
+    hasher.enableTableSpill();
+    
+    std::vector<std::thread> threads;
+    for (unsigned i = 0; i < numThreads; i++) {
+        threads.push_back(std::thread(&Hasher::worker, &hasher, i));
+    }
+    
+    hasher.signalComplete();
+    
+    for (std::thread& t : threads) {
+        t.join();
+    }
+    
+    hasher.mergeResults();
+    std::cout << "  Runs spilled: " << hasher.getSpilledRuns() << "\n";
+    
+    std::unordered_map<std::string, size_t> results;
+    std::string previous;
+    bool sorted = true;
+    hasher.streamResults([&](const std::string& kmer, uint64_t count) {
+        if (!results.empty() && kmer <= previous) sorted = false;
+        previous = kmer;
+        results[kmer] += count;
+    });
+    
+    bool correct = sorted && compareMaps(results, manualCount(testKmers));
+    std::cout << "  Results match: " << (correct ? "YES ✓" : "NO ✗") << "\n";
+}
+
+// Exact top-N against a manual count; Space-Saving must bound every true
+// count between count - error and count
+bool runTopN(size_t sketchCapacity) {
+    const unsigned numThreads = 4;
+    const size_t n = 25;
+    std::vector<std::string> testKmers = generateTestKmers(20000, 6);
+    std::queue<KmerBlock*> queue;
+    populateQueue(queue, testKmers, 100);
+    
+    Hasher hasher(queue, numThreads, 1009, 20);
+    if (sketchCapacity > 0) hasher.enableTopSketch(sketchCapacity);
+    
+    std::vector<std::thread> threads;
+    for (unsigned i = 0; i < numThreads; i++) {
+        threads.push_back(std::thread(&Hasher::worker, &hasher, i));
+    }
+    hasher.signalComplete();
+    for (std::thread& t : threads) {
+        t.join();
+    }
+    
+    auto top = hasher.topN(n);
+    auto expected = manualCount(testKmers);
+    
+    std::vector<TopEntry<std::string>> all;
+    for (const auto& [kmer, count] : expected) all.push_back({kmer, count, 0});
+    std::sort(all.begin(), all.end(), betterEntry<std::string>);
+    
+    if (top.size() != n) return false;
+    for (size_t i = 0; i < n; i++) {
+        if (sketchCapacity == 0) {
+            if (top[i].key != all[i].key || top[i].count != all[i].count) return false;
+        } else {
+            size_t actual = expected[top[i].key];
+            if (actual > top[i].count || actual + top[i].error < top[i].count) return false;
+        }
+    }
+    return true;
+}
+
+void testTopN() {
+    std::cout << "\n=== Test: Top-N k-mers ===\n";
+    std::cout << "  Exact: " << (runTopN(0) ? "YES ✓" : "NO ✗") << "\n";
+    std::cout << "  Space-Saving bounds: " << (runTopN(64) ? "YES ✓" : "NO ✗") << "\n";
+}
+
+void testBloomFilter() {
+    std::cout << "\n=== Test: Bloom filter pre-pass ===\n";
+    
+    // One worker, so no two threads race to add the same new k-mer
+    std::vector<std::string> testKmers = generateTestKmers(20000, 7);
+    std::queue<KmerBlock*> queue;
+    populateQueue(queue, testKmers, 100);
+    
+    Hasher hasher(queue, 1, 20011, 20);
+    hasher.enableBloomFilter(1 << 20);
+    std::thread worker(&Hasher::worker, &hasher, 0);
+    hasher.signalComplete();
+    worker.join();
+    hasher.mergeResults();
+    
+    std::unordered_map<std::string, size_t> expected;
+    for (const auto& [kmer, count] : manualCount(testKmers)) {
+        if (count >= 2) expected[kmer] = count;
+    }
+    std::unordered_map<std::string, size_t> results(hasher.getResults().begin(), hasher.getResults().end());
+    bool correct = compareMaps(results, expected);
+    std::cout << "  Singletons dropped, counts exact: " << (correct ? "YES ✓" : "NO ✗") << "\n";
+}
+
+void testApproximate() {
+    std::cout << "\n=== Test: Count-min sketch backend ===\n";
+    
+    const unsigned numThreads = 4;
+    std::vector<std::string> testKmers = generateTestKmers(50000, 8);
+    std::queue<KmerBlock*> queue;
+    populateQueue(queue, testKmers, 100);
+    
+    Hasher hasher(queue, numThreads, 1009, 20);
+    hasher.enableApproximate(0.001, 0.01);
+    std::vector<std::thread> threads;
+    for (unsigned i = 0; i < numThreads; i++) {
+        threads.push_back(std::thread(&Hasher::worker, &hasher, i));
+    }
+    hasher.signalComplete();
+    for (std::thread& t : threads) {
+        t.join();
+    }
+    
+    // Never under, and over by more than the bound only rarely
+    uint64_t bound = hasher.getApproximate()->errorBound();
+    size_t under = 0, outside = 0;
+    auto expected = manualCount(testKmers);
+    for (const auto& [kmer, count] : expected) {
+        uint64_t estimate = hasher.lookup(kmer);
+        if (estimate < count) under++;
+        if (estimate > count + bound) outside++;
+    }
+    bool correct = hasher.getApproximate()->totalCount() == testKmers.size() &&
+                   under == 0 && outside <= expected.size() / 50;
+    std::cout << "  Error bound " << bound << ", " << outside << " of " << expected.size()
+              << " beyond it: " << (correct ? "YES ✓" : "NO ✗") << "\n";
+}
+
+// Sort engine for every k-mer, or per partition with blocks split into
+// segments (the first 40 k-mers of a block in partition 0, which is sorted,
+// the next 40 in partition 1, which is hashed, the rest untagged)
+bool runSortEngine(bool byPartition) {
+    const unsigned numThreads = 4;
+    std::vector<std::string> testKmers = generateTestKmers(20000, 6);
+    std::queue<KmerBlock*> queue;
+    populateQueue(queue, testKmers, 100);
+    
+    Hasher hasher(queue, numThreads, 1009, 20);
+    if (byPartition) {
+        std::queue<KmerBlock*> tagged = queue;
+        while (!tagged.empty()) {
+            tagged.front()->segments = {{0, 40}, {1, 80}};
+            tagged.pop();
+        }
+        hasher.enableSortEngine({true, false}, 500);
+    } else {
+        hasher.enableSortEngine({}, 500);
+    }
+    
+    std::vector<std::thread> threads;
+    for (unsigned i = 0; i < numThreads; i++) {
+        threads.push_back(std::thread(&Hasher::worker, &hasher, i));
+    }
+    hasher.signalComplete();
+    for (std::thread& t : threads) {
+        t.join();
+    }
+    hasher.mergeResults();
+    
+    std::unordered_map<std::string, size_t> results(hasher.getResults().begin(), hasher.getResults().end());
+    return compareMaps(results, manualCount(testKmers));
+}
+
+void testSortEngine() {
+    std::cout << "\n=== Test: Sort engine ===\n";
+    std::cout << "  All partitions: " << (runSortEngine(false) ? "YES ✓" : "NO ✗") << "\n";
+    std::cout << "  Per partition: " << (runSortEngine(true) ? "YES ✓" : "NO ✗") << "\n";
+}
+
 void speedComparison() {
     std::cout << "\n=== Speed Comparison ===\n";
     const int numKmers = 5000000;
@@ -243,6 +513,96 @@ void speedComparison() {
     }
 }
 
+// Worker loads of routing every minimizer (weights[m] k-mers each) once
+std::vector<size_t> routeLoads(BucketBalancer& balancer, unsigned numWorkers,
+                               const std::vector<size_t>& weights) {
+    std::vector<size_t> load(numWorkers, 0);
+    for (uint64_t m = 0; m < weights.size(); m++) load[balancer.route(m, weights[m])] += weights[m];
+    return load;
+}
+
+double maxOverMean(const std::vector<size_t>& load) {
+    size_t total = 0;
+    for (size_t l : load) total += l;
+    return *std::max_element(load.begin(), load.end()) * (double)load.size() / total;
+}
+
+// Minimizer buckets with a skewed (Zipf-like) size distribution: the
+// static round-robin mapping is out of balance, the bin packing over a
+// sample is not; every partition has one owner; and partitions moving
+// between workers mid-stream leave the merged counts exact
+void testBucketBalancer() {
+    std::cout << "\n=== Test: Bucket balancer ===\n";
+
+    const unsigned numWorkers = 4;
+    const double maxImbalance = 1.05;
+    std::vector<size_t> weights(20000);
+    for (size_t m = 0; m < weights.size(); m++) weights[m] = 1 + 5000 / (m + 1);
+
+    // --static-buckets: no sample, no rebalancing, partition p on p % workers
+    BucketBalancer fixed(numWorkers, 16, 0, maxImbalance);
+    double staticImbalance = maxOverMean(routeLoads(fixed, numWorkers, weights));
+    bool roundRobin = true;
+    for (uint64_t m = 0; m < weights.size(); m++) {
+        roundRobin &= fixed.route(m, 1) == fixed.partitionOf(m) % numWorkers;
+    }
+
+    // Sample, repack, then route the same load
+    BucketBalancer balancer(numWorkers, 16, 0, maxImbalance);
+    for (uint64_t m = 0; m < weights.size(); m++) balancer.sample(m, weights[m]);
+    balancer.rebalance();
+    double packedImbalance = maxOverMean(routeLoads(balancer, numWorkers, weights));
+
+    // Every partition is owned by exactly one valid worker
+    std::unordered_map<size_t, unsigned> owners;
+    bool oneOwner = true;
+    for (uint64_t m = 0; m < weights.size(); m++) {
+        unsigned w = balancer.route(m, 1);
+        auto [it, inserted] = owners.emplace(balancer.partitionOf(m), w);
+        oneOwner &= w < numWorkers && it->second == w;
+    }
+    oneOwner &= owners.size() == numWorkers * 16;
+
+    std::cout << "  Max/mean load: static " << staticImbalance << ", packed " << packedImbalance << "\n";
+    std::cout << "  Static buckets stay round-robin: " << (roundRobin ? "YES ✓" : "NO ✗") << "\n";
+    bool balanced = staticImbalance > maxImbalance && packedImbalance <= maxImbalance;
+    std::cout << "  Packed within " << maxImbalance << ": " << (balanced ? "YES ✓" : "NO ✗") << "\n";
+    std::cout << "  One valid owner per partition: " << (oneOwner ? "YES ✓" : "NO ✗") << "\n";
+
+    // Count through a balancer that starts round-robin and repacks every
+    // 500 k-mers as the skew shows, so partitions move while in use
+    std::vector<std::string> testKmers;
+    std::vector<std::string> distinct = generateTestKmers(2000, 12);
+    for (size_t i = 0; i < distinct.size(); i++) {
+        for (size_t c = 0; c < weights[i] && c < 50; c++) testKmers.push_back(distinct[i]);
+    }
+    std::shuffle(testKmers.begin(), testKmers.end(), std::mt19937(42));
+
+    Hasher hasher(numWorkers, DEFAULT_TABLE_SIZE, DEFAULT_MAX_STEPS);
+    std::vector<std::thread> threads;
+    for (unsigned i = 0; i < numWorkers; i++) threads.emplace_back(&Hasher::worker, &hasher, i);
+    BucketBalancer moving(numWorkers, 16, 500, maxImbalance);
+    std::vector<KmerBlock*> blocks(numWorkers, nullptr);
+    for (const std::string& kmer : testKmers) {
+        unsigned w = moving.route(std::hash<std::string>{}(kmer), 1);
+        if (!blocks[w]) blocks[w] = new KmerBlock();
+        blocks[w]->kmers.push_back(kmer);
+        if (blocks[w]->kmers.size() >= 50) {
+            hasher.submit(w, blocks[w]);
+            blocks[w] = nullptr;
+        }
+    }
+    for (unsigned w = 0; w < numWorkers; w++) {
+        if (blocks[w]) hasher.submit(w, blocks[w]);
+    }
+    hasher.signalComplete();
+    for (std::thread& t : threads) t.join();
+    hasher.mergeResults();
+
+    bool exact = moving.partitionsSplit() && compareMaps(hasher.getResults(), manualCount(testKmers));
+    std::cout << "  Counts exact after partitions moved: " << (exact ? "YES ✓" : "NO ✗") << "\n";
+}
+
 int main() {
     std::cout << "=== Hasher Test Suite ===\n";
     
@@ -268,7 +628,31 @@ int main() {
     // Test 6: Empty queue
     testEmptyQueue();
     
-    // Test 7: Speed comparison
+    // Test 7: Routed mode
+    testRoutedHasher();
+    
+    // Test 8: Routed mode on a task pool
+    testPooledHasher();
+    
+    // Test 9: Table spill
+    testTableSpill();
+    
+    // Test 10: Top-N
+    testTopN();
+    
+    // Test 11: Bloom filter
+    testBloomFilter();
+    
+    // Test 12: Count-min sketch
+    testApproximate();
+    
+    // Test 13: Sort engine
+    testSortEngine();
+    
+    // Test 14: Bucket balancer
+    testBucketBalancer();
+    
+    // Test 15: Speed comparison
     speedComparison();
     
     std::cout << "\n=== All Tests Complete ===\n";
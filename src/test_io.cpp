@@ -0,0 +1,73 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <cstdio>
+#include "AsyncIO.h"
+#include "InputStream.h"
+
+std::string randomBytes(size_t length) {
+    std::string data(length, '\0');
+    for (size_t i = 0; i < length; i++) data[i] = "ACGT\n"[rand() % 5];
+    return data;
+}
+
+// Writes with small slots (many requests in flight, a partial last slot)
+// and reads back through both the ByteSource and istream paths
+bool testRoundTrip(AsyncIO::Backend backend, size_t length) {
+    AsyncIO::backend() = backend;
+    std::string path = "/tmp/test_io_roundtrip";
+    std::string data = randomBytes(length);
+
+    {
+        AsyncOFStream out(path, 3, 4096);
+        // Mix single characters and large writes
+        size_t i = 0;
+        while (i < data.size()) {
+            size_t n = std::min<size_t>(data.size() - i, rand() % 10000);
+            if (n < 10) {
+                for (size_t j = 0; j < n; j++) out << data[i + j];
+            } else {
+                out.write(data.data() + i, n);
+            }
+            i += n;
+        }
+        out.close();
+        if (!out) return false;
+    }
+
+    std::string viaSource;
+    auto source = openInput(path);
+    std::vector<char> buf(1000);
+    for (size_t n; (n = source->read(buf.data(), buf.size())) > 0;) viaSource.append(buf.data(), n);
+
+    std::string viaStream;
+    {
+        AsyncIFStream in(path, 2, 4096);
+        char c;
+        while (in.get(c)) viaStream += c;
+    }
+    std::remove(path.c_str());
+
+    bool ok = viaSource == data && viaStream == data;
+    std::cout << "  " << asyncBackendName() << ", " << length << " bytes: "
+              << (ok ? "PASS" : "FAIL") << "\n";
+    return ok;
+}
+
+int main() {
+    std::cout << "=== Async I/O Tests ===\n\n";
+    bool ok = true;
+
+    std::cout << "Test 1: io_uring (or its fallback) round trip\n";
+    ok &= testRoundTrip(AsyncIO::Backend::Auto, 0);
+    ok &= testRoundTrip(AsyncIO::Backend::Auto, 4096 * 3);
+    ok &= testRoundTrip(AsyncIO::Backend::Auto, 3 << 20);
+
+    std::cout << "\nTest 2: Thread pool round trip\n";
+    ok &= testRoundTrip(AsyncIO::Backend::Threads, 1);
+    ok &= testRoundTrip(AsyncIO::Backend::Threads, (3 << 20) + 17);
+
+    std::cout << "\n=== " << (ok ? "All Tests Passed" : "SOME TESTS FAILED") << " ===\n";
+    return ok ? 0 : 1;
+}
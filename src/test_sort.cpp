@@ -0,0 +1,61 @@
+#include <iostream>
+#include <vector>
+#include <random>
+#include <map>
+#include "Kmer.h"
+#include "SortCounter.h"
+
+// Radix sort and run-length counting against std::sort and a std::map,
+// with few distinct keys so there are long runs
+template <int K>
+bool testSortCount(size_t n, size_t distinct) {
+    using Traits = PackedKmerTraits<K>;
+    using Key = typename Traits::Key;
+    std::mt19937_64 rng(K + n);
+
+    std::vector<Key> pool;
+    for (size_t i = 0; i < distinct; i++) {
+        Key key = rng();
+        if constexpr (K > 31) key = (key << 64) | rng();
+        pool.push_back(key & Traits::MASK);
+    }
+    std::vector<Key> keys;
+    for (size_t i = 0; i < n; i++) keys.push_back(pool[rng() % distinct]);
+
+    std::vector<Key> expected(keys);
+    std::sort(expected.begin(), expected.end());
+    std::map<Key, uint64_t> counts;
+    for (const Key& key : keys) counts[key]++;
+
+    // Count the two halves separately, then merge
+    std::vector<Key> first(keys.begin(), keys.begin() + n / 2), second(keys.begin() + n / 2, keys.end());
+    std::vector<Key> scratch;
+    sortKeys<Traits>(first, scratch);
+    sortKeys<Traits>(second, scratch);
+    std::vector<std::pair<Key, uint64_t>> a, b;
+    countRuns(first, a);
+    countRuns(second, b);
+    mergeCounts(a, b);
+
+    sortKeys<Traits>(keys, scratch);
+    bool ok = keys == expected &&
+              std::vector<std::pair<Key, uint64_t>>(counts.begin(), counts.end()) == a;
+    std::cout << "  k=" << K << ", " << n << " k-mers, " << distinct << " distinct: "
+              << (ok ? "PASS" : "FAIL") << "\n";
+    return ok;
+}
+
+int main() {
+    std::cout << "=== Sort Counter Tests ===\n\n";
+    bool ok = true;
+
+    std::cout << "Test 1: Radix sort, run-length count and merge\n";
+    ok &= testSortCount<21>(100, 10);
+    ok &= testSortCount<21>(200000, 5000);
+    ok &= testSortCount<31>(300000, 100000);
+    ok &= testSortCount<51>(100000, 1000);
+    ok &= testSortCount<63>(100000, 50000);
+
+    std::cout << "\n=== " << (ok ? "All Tests Passed" : "SOME TESTS FAILED") << " ===\n";
+    return ok ? 0 : 1;
+}
@@ -5,62 +5,10 @@
 #include <fstream>
 #include "../src/phase1.h"
 #include "data_structs.h"
+#include "../src/FastReader.h"
 
 // Test
 
-// Super simple version: just read 1 file into bundles
-class FastReader {
-    std::string path;
-    size_t blockSize;
-
-public:
-    FastReader(std::string p, size_t bs = 1 << 20)  // default 1MB chunks
-        : path(std::move(p)), blockSize(bs) {}
-
-   std::vector<FastBundle> readFile() {
-        std::ifstream in(path);
-        if (!in) {
-            throw std::runtime_error("Could not open file: " + path);
-        }
-
-        std::vector<FastBundle> bundles;
-        std::string line;
-        std::string seqBuffer;
-        seqBuffer.reserve(blockSize * 2);
-
-        while (std::getline(in, line)) {
-
-            if (line.empty() || line[0] == '>') continue;
-
-            // Add DNA to buffer
-            seqBuffer += line;
-
-            // When buffer exceeds blockSize: push buffer to bundle 
-            while (seqBuffer.size() >= blockSize) {
-                FastBundle bundle(blockSize);
-                bundle.addBlock(seqBuffer.data(), blockSize);
-                bundle.finalize();
-                bundles.push_back(std::move(bundle));
-
-                seqBuffer.erase(0, blockSize);
-            }
-        }
-
-        // Push last  bundle
-        if (!seqBuffer.empty()) {
-            FastBundle bundle(seqBuffer.size());
-            bundle.addBlock(seqBuffer.data(), seqBuffer.size());
-            bundle.finalize();
-            bundles.push_back(std::move(bundle));
-        }
-
-        return bundles;
-    }
-
-
-};
-
-
 // basic stuff here
 void testGenerateKmers() {
     std::string seq = "AAGTC";
@@ -121,8 +69,8 @@ void testFastReader_Blocking() {
     out << "GGTAC\n";
     out.close();
 
-    // Batching
-    FastReader reader("temp_test.fasta");
+    // Batching, 5 bases per bundle
+    FastReader reader("temp_test.fasta", 5);
     auto bundles = reader.readFile();
 
     // 3 bundles: AAGTC, CGTAG, GTAC